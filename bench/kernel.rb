@@ -0,0 +1,43 @@
+# frozen_string_literal: true
+
+require 'benchmark'
+require 'bundler/setup'
+require 'numo/libsvm'
+
+# Compare the training and prediction time of the dense samples, whose kernel values are computed
+# with the SIMD instructions, to the same samples padded with zero features, which are too sparse
+# to be stored as dense arrays and have their kernel values computed with the LIBSVM nodes.
+N_REPEATS = Integer(ENV.fetch('N_REPEATS', 20))
+
+datasets = {
+  iris: Numo::Libsvm::SvmType::C_SVC,
+  housing: Numo::Libsvm::SvmType::EPSILON_SVR,
+  diabetes: Numo::Libsvm::SvmType::C_SVC
+}
+
+kernels = {
+  linear: Numo::Libsvm::KernelType::LINEAR,
+  rbf: Numo::Libsvm::KernelType::RBF,
+  poly: Numo::Libsvm::KernelType::POLY
+}
+
+def pad_zero_features(x)
+  Numo::NArray.hstack([x, Numo::DFloat.zeros(x.shape[0], x.shape[1] * 3)])
+end
+
+datasets.each do |name, svm_type|
+  x, y, x_test = Marshal.load(File.binread("#{__dir__}/../spec/#{name}.dat")) # rubocop:disable Security/MarshalLoad
+  x_test ||= x
+  kernels.each do |kernel_name, kernel_type|
+    param = { svm_type: svm_type, kernel_type: kernel_type, gamma: 1.0 / x.shape[1], degree: 2, C: 1 }
+    samples = { dense: [x, x_test], padded: [pad_zero_features(x), pad_zero_features(x_test)] }
+    puts "#{name} (#{x.shape.join('x')}), #{kernel_name} kernel:"
+    Benchmark.bm(16) do |bm|
+      samples.each do |label, (x_train, x_pred)|
+        model = nil
+        bm.report("#{label} train") { N_REPEATS.times { model = Numo::Libsvm.train(x_train, y, param) } }
+        bm.report("#{label} predict") { N_REPEATS.times { Numo::Libsvm.decision_function(x_pred, param, model) } }
+      end
+    end
+  end
+end
@@ -82,10 +82,24 @@ extern "C" void Init_libsvmext(void) {
   /**
    * Train the SVM model according to the given training data.
    *
-   * @overload train(x, y, param) -> Hash
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   * @overload train(x, y, param, init_model: nil, sparse_sv: false) -> Hash
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to be used for training the model.
    *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
    *   @param param [Hash] The parameters of an SVM model.
+   *   @param init_model [Hash] The model trained on the same samples whose dual coefficients are used as
+   *     the initial point of the solver (warm start), e.g. the model with the previous value of C.
+   *     The coefficients are clipped to the box of the new parameters. It is available for C-SVC and epsilon-SVR.
+   *   @param sparse_sv [Boolean] If true, the support vectors of the model are given as an array of
+   *     [indptr, indices, data] in CSR format instead of a 2-D array, whose size scales with the number of nonzero elements.
+   * @overload train(dataset, param, init_model: nil, sparse_sv: false) -> Hash
+   *   @param dataset [Dataset] The samples and labels converted to the LIBSVM format in advance.
+   *
+   * For classification, the pairs of classes are trained on the number of threads given by ':n_jobs'
+   * in the parameters (default: 1, or all processor cores if zero or negative). The trained model does not depend
+   * on the number of threads. The kernel values of dense samples are computed with the vector instructions selected
+   * for the CPU, whose order of summation differs from the plain LIBSVM, so the trained model may differ slightly
+   * between CPUs and from the one trained with LIBSVM.
    *
    * @example
    *   require 'numo/libsvm'
@@ -112,20 +126,50 @@ extern "C" void Init_libsvmext(void) {
    *   # [-1, 1]
    *
    * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
-   *   the sample array and label array do not have the same number of samples, or
-   *   the hyperparameter has an invalid value, this error is raised.
+   *   the sample array and label array do not have the same number of samples,
+   *   the hyperparameter has an invalid value, or the initial model is not valid, this error is raised.
    * @return [Hash] The model obtained from the training procedure.
+   *   The model hash given to the other functions may have the support vectors :SV either as a 2-D array or CSR format.
+   *   For the linear kernel, the model also has the primal weight vectors of each pair of classes as :w
+   *   (shape: [n_classes * (n_classes - 1) / 2, n_features]), which are used in prediction instead of the support vectors.
    */
-  rb_define_module_function(mLibsvm, "train", RUBY_METHOD_FUNC(numo_libsvm_train), 3);
+  rb_define_module_function(mLibsvm, "train", RUBY_METHOD_FUNC(numo_libsvm_train), -1);
+  /**
+   * Train the SVM model according to the given training data in CSR (compressed sparse row) format.
+   * The samples are converted to LIBSVM nodes directly from the nonzero elements without a dense matrix.
+   *
+   * @overload train_csr(indptr, indices, data, y, param, init_model: nil, sparse_sv: false) -> Hash
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The parameters of an SVM model.
+   *   @param init_model [Hash] The model trained on the same samples for warm start (see {train}).
+   *   @param sparse_sv [Boolean] If true, the support vectors of the model are given in CSR format (see {train}).
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, the label array is not 1-dimensional,
+   *   the CSR matrix and label array do not have the same number of samples,
+   *   the hyperparameter has an invalid value, or the initial model is not valid, this error is raised.
+   * @return [Hash] The model obtained from the training procedure.
+   */
+  rb_define_module_function(mLibsvm, "train_csr", RUBY_METHOD_FUNC(numo_libsvm_train_csr), -1);
   /**
    * Perform cross validation under given parameters. The given samples are separated to n_fols folds.
    * The predicted labels or values in the validation process are returned.
    *
    * @overload cv(x, y, param, n_folds) -> Numo::DFloat
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to be used for training the model.
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to be used for training the model.
    *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
    *   @param param [Hash] The parameters of an SVM model.
    *   @param n_folds [Integer] The number of folds.
+   * @overload cv(dataset, param, n_folds) -> Numo::DFloat
+   *   @param dataset [Dataset] The samples and labels converted to the LIBSVM format in advance.
+   *
+   * The folds are trained on the number of threads given by ':n_jobs' in the parameters
+   * (default: 1, or all processor cores if zero or negative).
+   * The fold assignment and the results do not depend on the number of threads.
    *
    * @example
    *   require 'numo/libsvm'
@@ -156,65 +200,501 @@ extern "C" void Init_libsvmext(void) {
    *   the hyperparameter has an invalid value, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
    */
-  rb_define_module_function(mLibsvm, "cv", RUBY_METHOD_FUNC(numo_libsvm_cross_validation), 4);
+  rb_define_module_function(mLibsvm, "cv", RUBY_METHOD_FUNC(numo_libsvm_cross_validation), -1);
+  /**
+   * Perform cross validation under given parameters with the samples in CSR (compressed sparse row) format.
+   *
+   * @overload cv_csr(indptr, indices, data, y, param, n_folds) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The parameters of an SVM model.
+   *   @param n_folds [Integer] The number of folds.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, the label array is not 1-dimensional,
+   *   the CSR matrix and label array do not have the same number of samples, or
+   *   the hyperparameter has an invalid value, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
+   */
+  rb_define_module_function(mLibsvm, "cv_csr", RUBY_METHOD_FUNC(numo_libsvm_cross_validation_csr), 6);
+  /**
+   * Search the best parameters in the grid of candidates with cross validation.
+   * The samples are converted once, and all the candidates are evaluated on the same folds.
+   *
+   * @overload grid_search(x, y, param, grid, n_folds) -> Hash
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to be used for training the model.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The base parameters of an SVM model shared by the candidates.
+   *   @param grid [Hash] The parameter names and the arrays of their values.
+   *     The candidates are all the combinations of the values merged into the base parameters.
+   *     The folds are split according to ':svm_type' of the base parameters, so the grid cannot vary it.
+   *   @param n_folds [Integer] The number of folds.
+   * @overload grid_search(dataset, param, grid, n_folds) -> Hash
+   *   @param dataset [Dataset] The samples and labels converted to the LIBSVM format in advance.
+   *
+   * The pairs of candidates and folds are trained on the number of threads given by ':n_jobs' in the base parameters
+   * (default: 1, or all processor cores if zero or negative). The scores do not depend on the number of threads.
+   *
+   * @example
+   *   require 'numo/libsvm'
+   *
+   *   # x: samples
+   *   # y: labels
+   *
+   *   param = {
+   *     svm_type: Numo::Libsvm::SvmType::C_SVC,
+   *     kernel_type: Numo::Libsvm::KernelType::RBF,
+   *     random_seed: 1,
+   *     n_jobs: -1
+   *   }
+   *   grid = { C: [0.1, 1, 10], gamma: [0.01, 0.1, 1] }
+   *
+   *   res = Numo::Libsvm.grid_search(x, y, param, grid, 5)
+   *   res[:params].zip(res[:scores].to_a).each { |p, s| puts "C: #{p[:C]}, gamma: #{p[:gamma]}, accuracy: #{s}" }
+   *   model = Numo::Libsvm.train(x, y, res[:best_param])
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
+   *   the sample array and label array do not have the same number of samples, no samples are given, the grid is
+   *   not a hash of non-empty arrays or has ':svm_type', or a candidate has an invalid value, this error is raised.
+   * @return [Hash] The parameters of the candidates as ':params', their scores as ':scores' (Numo::DFloat),
+   *   and the index and parameters of the best candidate as ':best_index' and ':best_param'.
+   *   The score is the accuracy for classification and one-class SVM, and the negative mean squared error for
+   *   regression. For one-class SVM, the predicted values of +1 or -1 are compared with the labels,
+   *   so the labels should be +1 for inliers and -1 for outliers.
+   */
+  rb_define_module_function(mLibsvm, "grid_search", RUBY_METHOD_FUNC(numo_libsvm_grid_search), -1);
   /**
    * Predict class labels or values for given samples.
    *
    * @overload predict(x, param, model) -> Numo::DFloat
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to calculate the scores.
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to calculate the scores.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
    *
+   * The samples are split into the number of threads given by ':n_jobs' in the parameters
+   * (default: 1, or all processor cores if zero or negative).
+   *
    * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
    */
   rb_define_module_function(mLibsvm, "predict", RUBY_METHOD_FUNC(numo_libsvm_predict), 3);
+  /**
+   * Predict class labels or values for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload predict_csr(indptr, indices, data, param, model) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
+   */
+  rb_define_module_function(mLibsvm, "predict_csr", RUBY_METHOD_FUNC(numo_libsvm_predict_csr), 5);
   /**
    * Calculate decision values for given samples.
    *
    * @overload decision_function(x, param, model) -> Numo::DFloat
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to calculate the scores.
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to calculate the scores.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
    *
+   * The samples are split into the number of threads given by ':n_jobs' in the parameters
+   * (default: 1, or all processor cores if zero or negative).
+   *
    * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The decision value of each sample.
    */
   rb_define_module_function(mLibsvm, "decision_function", RUBY_METHOD_FUNC(numo_libsvm_decision_function), 3);
+  /**
+   * Calculate decision values for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload decision_function_csr(indptr, indices, data, param, model) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The decision value of each sample.
+   */
+  rb_define_module_function(mLibsvm, "decision_function_csr", RUBY_METHOD_FUNC(numo_libsvm_decision_function_csr), 5);
   /**
    * Predict class probability for given samples. The model must have probability information calcualted in training procedure.
    * The parameter ':probability' set to 1 in training procedure.
    *
    * @overload predict_proba(x, param, model) -> Numo::DFloat
-   *   @param x [Numo::DFloat] (shape: [n_samples, n_features]) The samples to predict the class probabilities.
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to predict the class probabilities.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
    *
+   * The samples are split into the number of threads given by ':n_jobs' in the parameters
+   * (default: 1, or all processor cores if zero or negative).
+   *
    * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
    * @return [Numo::DFloat] (shape: [n_samples, n_classes]) Predicted probablity of each class per sample.
    */
   rb_define_module_function(mLibsvm, "predict_proba", RUBY_METHOD_FUNC(numo_libsvm_predict_proba), 3);
+  /**
+   * Predict class probability for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload predict_proba_csr(indptr, indices, data, param, model) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes]) Predicted probablity of each class per sample.
+   */
+  rb_define_module_function(mLibsvm, "predict_proba_csr", RUBY_METHOD_FUNC(numo_libsvm_predict_proba_csr), 5);
   /**
    * Load the SVM parameters and model from a text file with LIBSVM format.
    *
-   * @overload load_svm_model(filename) -> Array
+   * The lines of support vectors are parsed on the number of threads given by n_jobs.
+   *
+   * @overload load_svm_model(filename, sparse_sv: false, n_jobs: 1) -> Array
    *   @param filename [String] The path to a file to load.
+   *   @param sparse_sv [Boolean] If true, the support vectors of the model are given in CSR format (see {train}).
+   *   @param n_jobs [Integer] The number of threads parsing the file. If zero or a negative value is given,
+   *     all processor cores are used.
    *
    * @raise [IOError] This error raises when failed to load the model file.
    * @return [Array] Array contains the SVM parameters and model.
    */
-  rb_define_module_function(mLibsvm, "load_svm_model", RUBY_METHOD_FUNC(numo_libsvm_load_model), 1);
+  rb_define_module_function(mLibsvm, "load_svm_model", RUBY_METHOD_FUNC(numo_libsvm_load_model), -1);
   /**
    * Save the SVM parameters and model as a text file with LIBSVM format. The saved file can be used with the libsvm tools.
    * Note that the svm_save_model saves only the parameters necessary for estimation with the trained model.
+   * The lines of support vectors are formatted on the number of threads given by n_jobs.
    *
-   * @overload save_svm_model(filename, param, model) -> Boolean
+   * @overload save_svm_model(filename, param, model, n_jobs: 1) -> Boolean
    *   @param filename [String] The path to a file to save.
    *   @param param [Hash] The parameters of the trained SVM model.
    *   @param model [Hash] The model obtained from the training procedure.
+   *   @param n_jobs [Integer] The number of threads formatting the file. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [IOError] This error raises when failed to save the model file.
+   * @return [Boolean] true on success, or false if an error occurs.
+   */
+  rb_define_module_function(mLibsvm, "save_svm_model", RUBY_METHOD_FUNC(numo_libsvm_save_model), -1);
+
+  /**
+   * Document-class: Numo::Libsvm::Model
+   * Model is a class that holds the trained SVM model as the native LIBSVM structure.
+   * Since the model is not converted from Hash on every call, it is suitable for repeated prediction.
+   *
+   * @example
+   *   require 'numo/libsvm'
+   *
+   *   # x: samples
+   *   # y: labels
+   *   # x_test: testing samples
+   *
+   *   param = {
+   *     svm_type: Numo::Libsvm::SvmType::C_SVC,
+   *     kernel_type: Numo::Libsvm::KernelType::RBF,
+   *     gamma: 1.0,
+   *     C: 1
+   *   }
+   *   model = Numo::Libsvm::Model.train(x, y, param)
+   *   predicted = model.predict(x_test)
+   */
+  VALUE cModel = rb_define_class_under(mLibsvm, "Model", rb_cObject);
+  rb_define_alloc_func(cModel, numo_libsvm_model_alloc);
+  /**
+   * Create a new model from the parameters and the model Hash.
+   *
+   * @overload new(param, model) -> Model
+   *   @param param [Hash] The parameters of the trained SVM model.
+   *   @param model [Hash] The model obtained from the training procedure.
+   */
+  rb_define_method(cModel, "initialize", RUBY_METHOD_FUNC(numo_libsvm_model_init), 2);
+  rb_define_method(cModel, "initialize_copy", RUBY_METHOD_FUNC(numo_libsvm_model_init_copy), 1);
+  /**
+   * Train the SVM model according to the given training data.
+   *
+   * @overload train(x, y, param, init_model: nil) -> Model
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to be used for training the model.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The parameters of an SVM model.
+   *   @param init_model [Model, Hash] The model trained on the same samples whose dual coefficients are used as
+   *     the initial point of the solver (warm start). It is available for C-SVC and epsilon-SVR.
+   * @overload train(dataset, param, init_model: nil, share_sv: false) -> Model
+   *   @param dataset [Dataset] The samples and labels converted to the LIBSVM format in advance.
+   *   @param share_sv [Boolean] If true, the support vectors of the model refer to the samples of the dataset
+   *     instead of copying them, and the dataset is kept alive with the model.
+   *
+   * For classification, the pairs of classes are trained on the number of threads given by ':n_jobs'
+   * in the parameters (default: 1, or all processor cores if zero or negative). As with {Numo::Libsvm.train},
+   * the trained model may differ slightly between CPUs, since the kernel values of dense samples are computed with
+   * the vector instructions for the CPU.
+   *
+   * @example
+   *   # Train the models along the regularization path, starting each from the previous one.
+   *   model = nil
+   *   [0.1, 1, 10, 100].each { |c| model = Numo::Libsvm::Model.train(x, y, param.merge(C: c), init_model: model) }
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
+   *   the sample array and label array do not have the same number of samples,
+   *   the hyperparameter has an invalid value, or the initial model is not valid, this error is raised.
+   * @return [Model] The model obtained from the training procedure.
+   */
+  rb_define_singleton_method(cModel, "train", RUBY_METHOD_FUNC(numo_libsvm_model_s_train), -1);
+  /**
+   * Train the SVM model according to the given training data in CSR (compressed sparse row) format.
+   *
+   * @overload train_csr(indptr, indices, data, y, param, init_model: nil) -> Model
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param param [Hash] The parameters of an SVM model.
+   *   @param init_model [Model, Hash] The model trained on the same samples for warm start (see {train}).
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, the label array is not 1-dimensional,
+   *   the CSR matrix and label array do not have the same number of samples,
+   *   the hyperparameter has an invalid value, or the initial model is not valid, this error is raised.
+   * @return [Model] The model obtained from the training procedure.
+   */
+  rb_define_singleton_method(cModel, "train_csr", RUBY_METHOD_FUNC(numo_libsvm_model_s_train_csr), -1);
+  /**
+   * Load the SVM parameters and model from a text file with LIBSVM format.
+   * The support vectors are parsed into one buffer on the number of threads given by n_jobs.
+   *
+   * @overload load_svm_model(filename, n_jobs: 1) -> Model
+   *   @param filename [String] The path to a file to load.
+   *   @param n_jobs [Integer] The number of threads parsing the file. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [IOError] This error raises when failed to load the model file.
+   * @return [Model] The loaded model.
+   */
+  rb_define_singleton_method(cModel, "load_svm_model", RUBY_METHOD_FUNC(numo_libsvm_model_s_load_svm_model), -1);
+  /**
+   * Load the SVM model from a binary file saved with {save_binary_model}. The file is mapped into memory,
+   * and the support vectors are used in place without parsing, so that the processes loading the same file
+   * share them. On Windows, the file is read into memory instead. The file must not be modified in place while
+   * the loaded models are used; {save_binary_model} replaces the file with a new one, which is safe.
+   *
+   * @overload load_binary_model(filename) -> Model
+   *   @param filename [String] The path to a file to load.
+   *
+   * @raise [IOError] This error raises when failed to load the model file, or the file is not a valid binary model
+   *   saved on the platform with the same byte order.
+   * @return [Model] The loaded model.
+   */
+  rb_define_singleton_method(cModel, "load_binary_model", RUBY_METHOD_FUNC(numo_libsvm_model_s_load_binary_model), 1);
+  /**
+   * Load the SVM model from a String dumped with {#_dump}. This method is called by Marshal.load,
+   * and the support vectors are used in a copy of the String without conversion through Hash.
+   *
+   * @overload _load(data) -> Model
+   *   @param data [String] The binary model dumped with {#_dump}.
+   *
+   * @raise [ArgumentError] This error raises when the data is not a valid binary model dumped on the platform
+   *   with the same byte order.
+   * @return [Model] The loaded model.
+   */
+  rb_define_singleton_method(cModel, "_load", RUBY_METHOD_FUNC(numo_libsvm_model_s_load), 1);
+  /**
+   * Predict class labels or values for given samples.
+   *
+   * @overload predict(x, n_jobs: 1) -> Numo::DFloat
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to calculate the scores.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
+   */
+  rb_define_method(cModel, "predict", RUBY_METHOD_FUNC(numo_libsvm_model_predict), -1);
+  /**
+   * Predict class labels or values for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload predict_csr(indptr, indices, data, n_jobs: 1) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples]) The predicted class label or value of each sample.
+   */
+  rb_define_method(cModel, "predict_csr", RUBY_METHOD_FUNC(numo_libsvm_model_predict_csr), -1);
+  /**
+   * Calculate decision values for given samples.
+   *
+   * @overload decision_function(x, n_jobs: 1) -> Numo::DFloat
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to calculate the scores.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The decision value of each sample.
+   */
+  rb_define_method(cModel, "decision_function", RUBY_METHOD_FUNC(numo_libsvm_model_decision_function), -1);
+  /**
+   * Calculate decision values for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload decision_function_csr(indptr, indices, data, n_jobs: 1) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes * (n_classes - 1) / 2]) The decision value of each sample.
+   */
+  rb_define_method(cModel, "decision_function_csr", RUBY_METHOD_FUNC(numo_libsvm_model_decision_function_csr), -1);
+  /**
+   * Predict class probability for given samples. The model must have probability information calcualted in training procedure.
+   *
+   * @overload predict_proba(x, n_jobs: 1) -> Numo::DFloat
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to predict the class probabilities.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes]) Predicted probablity of each class per sample.
+   */
+  rb_define_method(cModel, "predict_proba", RUBY_METHOD_FUNC(numo_libsvm_model_predict_proba), -1);
+  /**
+   * Predict class probability for given samples in CSR (compressed sparse row) format.
+   *
+   * @overload predict_proba_csr(indptr, indices, data, n_jobs: 1) -> Numo::DFloat
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param n_jobs [Integer] The number of threads to split the samples. If zero or a negative value is given,
+   *     all processor cores are used.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, this error is raised.
+   * @return [Numo::DFloat] (shape: [n_samples, n_classes]) Predicted probablity of each class per sample.
+   */
+  rb_define_method(cModel, "predict_proba_csr", RUBY_METHOD_FUNC(numo_libsvm_model_predict_proba_csr), -1);
+  /**
+   * Save the SVM parameters and model as a text file with LIBSVM format.
+   * The lines of support vectors are formatted on the number of threads given by n_jobs.
+   *
+   * @overload save_svm_model(filename, n_jobs: 1) -> Boolean
+   *   @param filename [String] The path to a file to save.
+   *   @param n_jobs [Integer] The number of threads formatting the file. If zero or a negative value is given,
+   *     all processor cores are used.
    *
    * @raise [IOError] This error raises when failed to save the model file.
    * @return [Boolean] true on success, or false if an error occurs.
    */
-  rb_define_module_function(mLibsvm, "save_svm_model", RUBY_METHOD_FUNC(numo_libsvm_save_model), 3);
+  rb_define_method(cModel, "save_svm_model", RUBY_METHOD_FUNC(numo_libsvm_model_save_svm_model), -1);
+  /**
+   * Save the SVM model to a binary file that can be loaded with {load_binary_model}. The file holds the parameters
+   * and the model arrays in aligned sections with the native byte order, instead of the LIBSVM text format.
+   * The model is written to a temporary file in the same directory, which is renamed over the file, so that
+   * the models already loaded from the file are not affected.
+   *
+   * @overload save_binary_model(filename) -> Boolean
+   *   @param filename [String] The path to a file to save.
+   *
+   * @raise [IOError] This error raises when failed to save the model file.
+   * @return [Boolean] true on success.
+   */
+  rb_define_method(cModel, "save_binary_model", RUBY_METHOD_FUNC(numo_libsvm_model_save_binary_model), 1);
+  /**
+   * Return the parameters of the SVM model. The parameters for training only, such as class weights, are not included.
+   *
+   * @overload param() -> Hash
+   * @return [Hash] The parameters of the SVM model.
+   */
+  rb_define_method(cModel, "param", RUBY_METHOD_FUNC(numo_libsvm_model_param), 0);
+  /**
+   * Return the model as Hash that can be given to the module functions such as Numo::Libsvm.predict.
+   *
+   * @overload to_h(sparse_sv: false) -> Hash
+   *   @param sparse_sv [Boolean] If true, the support vectors are given in CSR format (see {Numo::Libsvm.train}).
+   * @return [Hash] The model.
+   */
+  rb_define_method(cModel, "to_h", RUBY_METHOD_FUNC(numo_libsvm_model_to_h), -1);
+  /**
+   * Dump the SVM model to a String with the format of {#save_binary_model}. This method is called by Marshal.dump.
+   *
+   * @overload _dump(level) -> String
+   *   @param level [Integer] The depth limit given by Marshal.dump, which is not used.
+   * @return [String] The binary model.
+   */
+  rb_define_method(cModel, "_dump", RUBY_METHOD_FUNC(numo_libsvm_model_dump), 1);
+
+  /**
+   * Document-class: Numo::Libsvm::Dataset
+   * Dataset is a class that holds the samples and labels converted to the LIBSVM format.
+   * The conversion is performed once, and the dataset can be given to train, cv, and grid_search repeatedly
+   * instead of the samples and labels.
+   *
+   * @example
+   *   require 'numo/libsvm'
+   *
+   *   dataset = Numo::Libsvm::Dataset.new(x, y)
+   *   param = { svm_type: Numo::Libsvm::SvmType::C_SVC, kernel_type: Numo::Libsvm::KernelType::RBF, gamma: 1.0 }
+   *   [0.1, 1, 10].each { |c| p Numo::Libsvm.cv(dataset, param.merge(C: c), 5) }
+   */
+  VALUE cDataset = rb_define_class_under(mLibsvm, "Dataset", rb_cObject);
+  rb_define_alloc_func(cDataset, numo_libsvm_dataset_alloc);
+  /**
+   * Create a new dataset from the samples and labels.
+   *
+   * @overload new(x, y, n_jobs: 1) -> Dataset
+   *   @param x [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_samples, n_features])
+   *     The samples to be used for training the model.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *   @param n_jobs [Integer] The number of threads converting the samples (default: 1).
+   *     If zero or a negative value is given, all processor cores are used.
+   *
+   * @raise [ArgumentError] If the sample array is not 2-dimensional, the label array is not 1-dimensional,
+   *   or the sample array and label array do not have the same number of samples, this error is raised.
+   */
+  rb_define_method(cDataset, "initialize", RUBY_METHOD_FUNC(numo_libsvm_dataset_init), -1);
+  rb_define_method(cDataset, "initialize_copy", RUBY_METHOD_FUNC(numo_libsvm_dataset_init_copy), 1);
+  /**
+   * Create a new dataset from the samples in CSR (compressed sparse row) format and labels.
+   *
+   * @overload from_csr(indptr, indices, data, y) -> Dataset
+   *   @param indptr [Numo::Int32] (shape: [n_samples + 1]) The row pointers of the samples in CSR format.
+   *   @param indices [Numo::Int32] (shape: [n_nonzeros])
+   *     The zero-based column indices of the nonzero elements, sorted in ascending order for each row.
+   *   @param data [Numo::DFloat, Numo::SFloat, Numo::Int32, Numo::UInt8] (shape: [n_nonzeros]) The nonzero elements.
+   *   @param y [Numo::DFloat] (shape: [n_samples]) The labels or target values for samples.
+   *
+   * @raise [ArgumentError] If the CSR matrix is not valid, the label array is not 1-dimensional,
+   *   or the CSR matrix and label array do not have the same number of samples, this error is raised.
+   */
+  rb_define_singleton_method(cDataset, "from_csr", RUBY_METHOD_FUNC(numo_libsvm_dataset_s_from_csr), 4);
+  /**
+   * Return the number of samples.
+   *
+   * @overload n_samples() -> Integer
+   * @return [Integer] The number of samples.
+   */
+  rb_define_method(cDataset, "n_samples", RUBY_METHOD_FUNC(numo_libsvm_dataset_n_samples), 0);
 }
@@ -31,10 +31,36 @@
 #ifndef LIBSVMEXT_HPP
 #define LIBSVMEXT_HPP 1
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if !defined(__cpp_lib_to_chars)
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <ruby.h>
+#include <ruby/thread.h>
 
 #include <numo/narray.h>
 #include <numo/template.h>
@@ -45,11 +71,43 @@ typedef struct svm_model LibSvmModel;
 typedef struct svm_node LibSvmNode;
 typedef struct svm_parameter LibSvmParameter;
 typedef struct svm_problem LibSvmProblem;
+typedef struct svm_rand LibSvmRand;
 
 void printNull(const char* s) {}
 
 #define NR_MARKS 10
 
+/** PARALLEL PROCESSING */
+int getNumJobs(VALUE n_jobs) {
+  if (NIL_P(n_jobs)) return 1;
+  const int n_jobs_ = NUM2INT(n_jobs);
+  if (n_jobs_ > 0) return n_jobs_;
+  const int n_cores = (int)std::thread::hardware_concurrency();
+  return n_cores > 0 ? n_cores : 1;
+}
+
+/**
+ * Run func(thread_id, task) for the tasks in [0, n_tasks) on n_threads threads including the calling thread.
+ * The tasks are dispatched dynamically, and thread_id in [0, n_threads) can be used to select per-thread buffers.
+ * This function must not call the Ruby API in func, since it is intended to be called without the GVL.
+ */
+template <class Function> void runParallel(const int n_threads, const int n_tasks, Function func) {
+  std::atomic<int> next_task(0);
+  auto worker = [&](const int thread_id) {
+    for (int task = next_task++; task < n_tasks; task = next_task++) func(thread_id, task);
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < n_threads && t < n_tasks; t++) {
+    try {
+      threads.emplace_back(worker, t);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  worker(0);
+  for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+}
+
 /** CONVERTERS */
 VALUE convertVectorXiToNArray(const int* const arr, const int size) {
   size_t shape[1] = {(size_t)size};
@@ -180,35 +238,149 @@ LibSvmNode** convertNArrayToLibSvmNode(VALUE vec_val) {
   return support_vecs;
 }
 
-LibSvmNode* convertVectorXdToLibSvmNode(const double* const arr, const int size) {
-  int n_nonzero_elements = 0;
-  for (int i = 0; i < size; i++) {
-    if (arr[i] != 0.0) n_nonzero_elements++;
+/**
+ * Convert the support vectors to CSR matrix given as an array of [indptr, indices, data] with zero-based column indices.
+ * The nodes are copied as they are, so that the memory and time scale with the number of nodes instead of
+ * the number of elements of the dense matrix.
+ */
+VALUE convertLibSvmNodeToCsrMatrix(const LibSvmNode* const* support_vecs, const int n_support_vecs) {
+  size_t indptr_shape[1] = {(size_t)n_support_vecs + 1};
+  VALUE indptr_val = rb_narray_new(numo_cInt32, 1, indptr_shape);
+  int32_t* indptr = (int32_t*)na_get_pointer_for_write(indptr_val);
+  indptr[0] = 0;
+  for (int i = 0; i < n_support_vecs; i++) {
+    int n_nodes = 0;
+    while (support_vecs[i][n_nodes].index != -1) n_nodes++;
+    indptr[i + 1] = indptr[i] + n_nodes;
+  }
+
+  size_t nnz_shape[1] = {(size_t)indptr[n_support_vecs]};
+  VALUE indices_val = rb_narray_new(numo_cInt32, 1, nnz_shape);
+  VALUE data_val = rb_narray_new(numo_cDFloat, 1, nnz_shape);
+  int32_t* indices = (int32_t*)na_get_pointer_for_write(indices_val);
+  double* data = (double*)na_get_pointer_for_write(data_val);
+  for (int i = 0; i < n_support_vecs; i++) {
+    for (int32_t k = indptr[i]; k < indptr[i + 1]; k++) {
+      indices[k] = support_vecs[i][k - indptr[i]].index - 1;
+      data[k] = support_vecs[i][k - indptr[i]].value;
+    }
+  }
+
+  VALUE csr_val = rb_ary_new2(3);
+  rb_ary_store(csr_val, 0, indptr_val);
+  rb_ary_store(csr_val, 1, indices_val);
+  rb_ary_store(csr_val, 2, data_val);
+  return csr_val;
+}
+
+/**
+ * Cast and check the CSR matrix of support vectors in the model hash, and return it as an array of [indptr, indices, data].
+ * The column index -1 is allowed for the node of the sample serial number in the model with precomputed kernel.
+ */
+VALUE prepareCsrSupportVectors(VALUE csr_val, const int n_support_vecs) {
+  if (RARRAY_LEN(csr_val) != 3) {
+    rb_raise(rb_eArgError, "Expect support vectors of CSR matrix to be an array of indptr, indices, and data.");
+    return Qnil;
+  }
+  VALUE indptr_val = rb_ary_entry(csr_val, 0);
+  VALUE indices_val = rb_ary_entry(csr_val, 1);
+  VALUE data_val = rb_ary_entry(csr_val, 2);
+  if (CLASS_OF(indptr_val) != numo_cInt32) indptr_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, indptr_val);
+  if (CLASS_OF(indices_val) != numo_cInt32) indices_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, indices_val);
+  if (CLASS_OF(data_val) != numo_cDFloat) data_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, data_val);
+  if (!RTEST(nary_check_contiguous(indptr_val))) indptr_val = nary_dup(indptr_val);
+  if (!RTEST(nary_check_contiguous(indices_val))) indices_val = nary_dup(indices_val);
+  if (!RTEST(nary_check_contiguous(data_val))) data_val = nary_dup(data_val);
+
+  narray_t* indptr_nary;
+  narray_t* indices_nary;
+  narray_t* data_nary;
+  GetNArray(indptr_val, indptr_nary);
+  GetNArray(indices_val, indices_nary);
+  GetNArray(data_val, data_nary);
+  if (NA_NDIM(indptr_nary) != 1 || NA_NDIM(indices_nary) != 1 || NA_NDIM(data_nary) != 1 ||
+      (long)NA_SIZE(indptr_nary) != (long)n_support_vecs + 1 || NA_SIZE(indices_nary) != NA_SIZE(data_nary)) {
+    rb_raise(rb_eArgError, "Expect support vectors of CSR matrix to have n_support_vecs + 1 row pointers, "
+                           "and indices and data of the same number of elements.");
+    return Qnil;
+  }
+
+  const int32_t* const indptr = (int32_t*)na_get_pointer_for_read(indptr_val);
+  const int32_t* const indices = (int32_t*)na_get_pointer_for_read(indices_val);
+  // The row pointers are checked to be non-decreasing from 0 to the number of elements before the column indices
+  // are read, so that every row is within the indices.
+  bool is_valid = indptr[0] == 0 && indptr[n_support_vecs] == (long)NA_SIZE(indices_nary);
+  for (int i = 0; is_valid && i < n_support_vecs; i++) is_valid = indptr[i] <= indptr[i + 1];
+  for (int i = 0; is_valid && i < n_support_vecs; i++) {
+    for (int32_t k = indptr[i]; is_valid && k < indptr[i + 1]; k++) {
+      is_valid = indices[k] >= -1 && indices[k] < INT32_MAX - 1 && (k == indptr[i] || indices[k - 1] < indices[k]);
+    }
+  }
+  if (!is_valid) {
+    rb_raise(rb_eArgError, "Expect support vectors of CSR matrix to have valid row pointers and sorted column indices.");
+    return Qnil;
+  }
+
+  VALUE prepared_val = rb_ary_new2(3);
+  rb_ary_store(prepared_val, 0, indptr_val);
+  rb_ary_store(prepared_val, 1, indices_val);
+  rb_ary_store(prepared_val, 2, data_val);
+  return prepared_val;
+}
+
+LibSvmNode** convertCsrMatrixToLibSvmNode(VALUE csr_val, const int n_support_vecs) {
+  const int32_t* const indptr = (int32_t*)na_get_pointer_for_read(rb_ary_entry(csr_val, 0));
+  const int32_t* const indices = (int32_t*)na_get_pointer_for_read(rb_ary_entry(csr_val, 1));
+  const double* const data = (double*)na_get_pointer_for_read(rb_ary_entry(csr_val, 2));
+  LibSvmNode** support_vecs = ALLOC_N(LibSvmNode*, n_support_vecs);
+  for (int i = 0; i < n_support_vecs; i++) {
+    const int n_nodes = indptr[i + 1] - indptr[i];
+    support_vecs[i] = ALLOC_N(LibSvmNode, n_nodes + 1);
+    for (int k = 0; k < n_nodes; k++) {
+      support_vecs[i][k].index = indices[indptr[i] + k] + 1;
+      support_vecs[i][k].value = data[indptr[i] + k];
+    }
+    support_vecs[i][n_nodes].index = -1;
+    support_vecs[i][n_nodes].value = 0.0;
   }
 
-  LibSvmNode* node = ALLOC_N(LibSvmNode, n_nonzero_elements + 1);
-  for (int i = 0, j = 0; i < size; i++) {
+  RB_GC_GUARD(csr_val);
+
+  return support_vecs;
+}
+
+void copyVectorXdToLibSvmNode(const double* const arr, const int size, LibSvmNode* node) {
+  int n_nonzero_elements = 0;
+  for (int i = 0; i < size; i++) {
     if (arr[i] != 0.0) {
-      node[j].index = i + 1;
-      node[j].value = arr[i];
-      j++;
+      node[n_nonzero_elements].index = i + 1;
+      node[n_nonzero_elements].value = arr[i];
+      n_nonzero_elements++;
     }
   }
   node[n_nonzero_elements].index = -1;
   node[n_nonzero_elements].value = 0.0;
-
-  return node;
 }
 
+/**
+ * Convert the model hash to the model. The support vectors are given as a 2-D array or CSR matrix.
+ */
 LibSvmModel* convertHashToLibSvmModel(VALUE model_hash) {
+  // The CSR matrix of support vectors is checked before the model is allocated, since it may raise ArgumentError.
+  VALUE el = rb_hash_aref(model_hash, ID2SYM(rb_intern("l")));
+  const int n_support_vecs = !NIL_P(el) ? NUM2INT(el) : 0;
+  VALUE support_vecs = rb_hash_aref(model_hash, ID2SYM(rb_intern("SV")));
+  if (RB_TYPE_P(support_vecs, T_ARRAY)) support_vecs = prepareCsrSupportVectors(support_vecs, n_support_vecs);
+
   LibSvmModel* model = ALLOC(LibSvmModel);
-  VALUE el;
   el = rb_hash_aref(model_hash, ID2SYM(rb_intern("nr_class")));
   model->nr_class = !NIL_P(el) ? NUM2INT(el) : 0;
-  el = rb_hash_aref(model_hash, ID2SYM(rb_intern("l")));
-  model->l = !NIL_P(el) ? NUM2INT(el) : 0;
-  el = rb_hash_aref(model_hash, ID2SYM(rb_intern("SV")));
-  model->SV = convertNArrayToLibSvmNode(el);
+  model->l = n_support_vecs;
+  if (RB_TYPE_P(support_vecs, T_ARRAY)) {
+    model->SV = convertCsrMatrixToLibSvmNode(support_vecs, n_support_vecs);
+  } else {
+    model->SV = convertNArrayToLibSvmNode(support_vecs);
+  }
   el = rb_hash_aref(model_hash, ID2SYM(rb_intern("sv_coef")));
   model->sv_coef = convertNArrayToMatrixXd(el);
   el = rb_hash_aref(model_hash, ID2SYM(rb_intern("rho")));
@@ -227,13 +399,98 @@ LibSvmModel* convertHashToLibSvmModel(VALUE model_hash) {
   model->nSV = convertNArrayToVectorXi(el);
   el = rb_hash_aref(model_hash, ID2SYM(rb_intern("free_sv")));
   model->free_sv = !NIL_P(el) ? NUM2INT(el) : 0;
+
+  RB_GC_GUARD(support_vecs);
+
   return model;
 }
 
-VALUE convertLibSvmModelToHash(const LibSvmModel* const model) {
+/**
+ * Collapse the support vectors of a linear kernel model into the primal weight vectors, w = sum_s sv_coef[s] * sv_s,
+ * one for each pair of classes (or one for single output models), as a row-major [n_outputs, n_weight_features] matrix.
+ * NULL is returned for the non-linear kernel models and the models whose weight matrix is larger than the coefficient
+ * weighted support vectors, where the prediction with the support vectors is cheaper.
+ */
+double* convertLibSvmModelToLinearWeights(const LibSvmModel* const model, int* n_weight_features) {
+  *n_weight_features = 0;
+  if (model->param.kernel_type != LINEAR || model->SV == NULL || model->sv_coef == NULL || model->rho == NULL) return NULL;
+
+  const int n_classes = model->nr_class;
+  const int svm_type = model->param.svm_type;
+  const bool is_single_output = svm_type == ONE_CLASS || svm_type == EPSILON_SVR || svm_type == NU_SVR;
+  if (!is_single_output && model->nSV == NULL) return NULL;
+  const int n_outputs = is_single_output ? 1 : n_classes * (n_classes - 1) / 2;
+
+  size_t n_nonzeros = 0;
+  int n_features = 0;
+  for (int i = 0; i < model->l; i++) {
+    for (int j = 0; model->SV[i][j].index != -1; j++) {
+      if (model->SV[i][j].index < 1) return NULL;
+      if (n_features < model->SV[i][j].index) n_features = model->SV[i][j].index;
+      n_nonzeros++;
+    }
+  }
+  if (n_features == 0 || (size_t)n_outputs * n_features > n_nonzeros * (n_classes - 1)) return NULL;
+
+  double* weights = ALLOC_N(double, (size_t)n_outputs * n_features);
+  memset(weights, 0, (size_t)n_outputs * n_features * sizeof(double));
+  if (is_single_output) {
+    for (int s = 0; s < model->l; s++) {
+      const LibSvmNode* const sv = model->SV[s];
+      for (int k = 0; sv[k].index != -1; k++) weights[sv[k].index - 1] += model->sv_coef[0][s] * sv[k].value;
+    }
+  } else {
+    // The decision value for the pair of classes i and j is given by the support vectors of class i with sv_coef[j - 1]
+    // and those of class j with sv_coef[i], as in svm_predict_values.
+    int* start = ALLOC_N(int, n_classes);
+    start[0] = 0;
+    for (int i = 1; i < n_classes; i++) start[i] = start[i - 1] + model->nSV[i - 1];
+    for (int i = 0, p = 0; i < n_classes; i++) {
+      for (int j = i + 1; j < n_classes; j++, p++) {
+        double* w = &weights[(size_t)p * n_features];
+        for (int s = start[i]; s < start[i] + model->nSV[i]; s++) {
+          const LibSvmNode* const sv = model->SV[s];
+          for (int k = 0; sv[k].index != -1; k++) w[sv[k].index - 1] += model->sv_coef[j - 1][s] * sv[k].value;
+        }
+        for (int s = start[j]; s < start[j] + model->nSV[j]; s++) {
+          const LibSvmNode* const sv = model->SV[s];
+          for (int k = 0; sv[k].index != -1; k++) w[sv[k].index - 1] += model->sv_coef[i][s] * sv[k].value;
+        }
+      }
+    }
+    xfree(start);
+  }
+
+  *n_weight_features = n_features;
+  return weights;
+}
+
+/**
+ * Convert the model to the model hash. The support vectors are given as CSR matrix if sparse_sv is true,
+ * or else as a 2-D array.
+ */
+VALUE convertLibSvmModelToHash(const LibSvmModel* const model, const bool sparse_sv) {
   const int n_classes = model->nr_class;
   const int n_support_vecs = model->l;
-  VALUE support_vecs = model->SV ? convertLibSvmNodeToNArray(model->SV, n_support_vecs) : Qnil;
+  int n_weight_features = 0;
+  double* weights = convertLibSvmModelToLinearWeights(model, &n_weight_features);
+  VALUE linear_weights = Qnil;
+  if (weights) {
+    const int svm_type = model->param.svm_type;
+    const bool is_single_output = svm_type == ONE_CLASS || svm_type == EPSILON_SVR || svm_type == NU_SVR;
+    size_t w_shape[2] = {is_single_output ? 1 : (size_t)(n_classes * (n_classes - 1) / 2), (size_t)n_weight_features};
+    linear_weights = rb_narray_new(numo_cDFloat, 2, w_shape);
+    memcpy(na_get_pointer_for_write(linear_weights), weights, w_shape[0] * w_shape[1] * sizeof(double));
+    xfree(weights);
+  }
+  VALUE support_vecs = Qnil;
+  if (model->SV) {
+    if (sparse_sv) {
+      support_vecs = convertLibSvmNodeToCsrMatrix(model->SV, n_support_vecs);
+    } else {
+      support_vecs = convertLibSvmNodeToNArray(model->SV, n_support_vecs);
+    }
+  }
   VALUE coefficients = model->sv_coef ? convertMatrixXdToNArray(model->sv_coef, n_classes - 1, n_support_vecs) : Qnil;
   VALUE intercepts = model->rho ? convertVectorXdToNArray(model->rho, n_classes * (n_classes - 1) / 2) : Qnil;
   VALUE prob_alpha = model->probA ? convertVectorXdToNArray(model->probA, n_classes * (n_classes - 1) / 2) : Qnil;
@@ -255,11 +512,17 @@ VALUE convertLibSvmModelToHash(const LibSvmModel* const model) {
   rb_hash_aset(model_hash, ID2SYM(rb_intern("label")), labels);
   rb_hash_aset(model_hash, ID2SYM(rb_intern("nSV")), n_support_vecs_each_class);
   rb_hash_aset(model_hash, ID2SYM(rb_intern("free_sv")), INT2NUM(model->free_sv));
+  rb_hash_aset(model_hash, ID2SYM(rb_intern("w")), linear_weights);
   return model_hash;
 }
 
+/**
+ * Convert the parameter hash to the parameter. The values are read before the parameter is allocated,
+ * since the conversions may raise TypeError.
+ */
 LibSvmParameter* convertHashToLibSvmParameter(VALUE param_hash) {
-  LibSvmParameter* param = ALLOC(LibSvmParameter);
+  LibSvmParameter values;
+  LibSvmParameter* const param = &values;
   VALUE el;
   el = rb_hash_aref(param_hash, ID2SYM(rb_intern("svm_type")));
   param->svm_type = !NIL_P(el) ? NUM2INT(el) : C_SVC;
@@ -287,19 +550,29 @@ LibSvmParameter* convertHashToLibSvmParameter(VALUE param_hash) {
   param->shrinking = RB_TYPE_P(el, T_FALSE) ? 0 : 1;
   el = rb_hash_aref(param_hash, ID2SYM(rb_intern("probability")));
   param->probability = RB_TYPE_P(el, T_TRUE) ? 1 : 0;
-  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("weight_label")));
-  param->weight_label = NULL;
-  if (!NIL_P(el)) {
-    param->weight_label = ALLOC_N(int, param->nr_weight);
-    memcpy(param->weight_label, (int32_t*)na_get_pointer_for_read(el), param->nr_weight * sizeof(int32_t));
+  param->nr_thread = 1;
+  VALUE weight_label = rb_hash_aref(param_hash, ID2SYM(rb_intern("weight_label")));
+  const int32_t* const weight_label_ptr = !NIL_P(weight_label) ? (int32_t*)na_get_pointer_for_read(weight_label) : NULL;
+  VALUE weight = rb_hash_aref(param_hash, ID2SYM(rb_intern("weight")));
+  const double* const weight_ptr = !NIL_P(weight) ? (double*)na_get_pointer_for_read(weight) : NULL;
+
+  LibSvmParameter* converted = ALLOC(LibSvmParameter);
+  *converted = values;
+  converted->weight_label = NULL;
+  if (weight_label_ptr) {
+    converted->weight_label = ALLOC_N(int, values.nr_weight);
+    memcpy(converted->weight_label, weight_label_ptr, values.nr_weight * sizeof(int32_t));
   }
-  el = rb_hash_aref(param_hash, ID2SYM(rb_intern("weight")));
-  param->weight = NULL;
-  if (!NIL_P(el)) {
-    param->weight = ALLOC_N(double, param->nr_weight);
-    memcpy(param->weight, (double*)na_get_pointer_for_read(el), param->nr_weight * sizeof(double));
+  converted->weight = NULL;
+  if (weight_ptr) {
+    converted->weight = ALLOC_N(double, values.nr_weight);
+    memcpy(converted->weight, weight_ptr, values.nr_weight * sizeof(double));
   }
-  return param;
+
+  RB_GC_GUARD(weight_label);
+  RB_GC_GUARD(weight);
+
+  return converted;
 }
 
 VALUE convertLibSvmParameterToHash(const LibSvmParameter* const param) {
@@ -324,66 +597,371 @@ VALUE convertLibSvmParameterToHash(const LibSvmParameter* const param) {
   return param_hash;
 }
 
-LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val) {
-  narray_t* x_nary;
-  GetNArray(x_val, x_nary);
-  const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  const double* const y_ptr = (double*)na_get_pointer_for_read(y_val);
-
+/**
+ * Allocate the problem whose nodes of all samples are held in one contiguous buffer in the order of samples,
+ * so that the kernel evaluations stream through memory. The buffer is returned as nodes, and problem->x[0] points
+ * to its head when the problem has samples. deleteLibSvmProblem frees the buffer at once.
+ */
+LibSvmProblem* allocLibSvmProblem(const int n_samples, const size_t n_nodes, LibSvmNode** nodes) {
   LibSvmProblem* problem = ALLOC(LibSvmProblem);
   problem->l = n_samples;
   problem->x = ALLOC_N(LibSvmNode*, n_samples);
   problem->y = ALLOC_N(double, n_samples);
+  *nodes = NULL;
+  if (n_samples > 0) {
+    *nodes = ALLOC_N(LibSvmNode, n_nodes);
+    problem->x[0] = *nodes;
+  }
+  return problem;
+}
 
-  int last_feature_id = 0;
-  bool is_padded = false;
-  for (int i = 0; i < n_samples; i++) {
-    int n_nonzero_features = 0;
-    for (int j = 0; j < n_features; j++) {
-      if (x_ptr[i * n_features + j] != 0.0) {
-        n_nonzero_features += 1;
-        last_feature_id = j + 1;
-      }
+/**
+ * Dense samples of 2-D NArray read in place, which may be a strided or indexed view such as a slice or transpose.
+ * The element at row i and column j is at ptr + row offset + column offset in bytes, where the offsets along each axis
+ * are given by the index array if it is not NULL, or else by the stride.
+ */
+typedef struct {
+  const char* ptr;
+  ssize_t row_stride;
+  ssize_t col_stride;
+  const size_t* row_offsets;
+  const size_t* col_offsets;
+} LibSvmDenseSamples;
+
+LibSvmDenseSamples getDenseSamples(VALUE x_val) {
+  const VALUE x_class = CLASS_OF(x_val);
+  size_t element_size = sizeof(double);
+  if (x_class == numo_cSFloat) element_size = sizeof(float);
+  if (x_class == numo_cInt32) element_size = sizeof(int32_t);
+  if (x_class == numo_cUInt8) element_size = sizeof(uint8_t);
+  narray_t* x_nary;
+  GetNArray(x_val, x_nary);
+  LibSvmDenseSamples x;
+  x.ptr = na_get_pointer_for_read(x_val) + na_get_offset(x_val);
+  x.row_stride = (ssize_t)(NA_SHAPE(x_nary)[1] * element_size);
+  x.col_stride = (ssize_t)element_size;
+  x.row_offsets = NULL;
+  x.col_offsets = NULL;
+  if (NA_TYPE(x_nary) == NARRAY_VIEW_T && NA_VIEW_STRIDX(x_nary) != NULL) {
+    const stridx_t* const stridx = NA_VIEW_STRIDX(x_nary);
+    if (SDX_IS_INDEX(stridx[0])) {
+      x.row_offsets = SDX_GET_INDEX(stridx[0]);
+    } else {
+      x.row_stride = SDX_GET_STRIDE(stridx[0]);
     }
-    if (!is_padded && last_feature_id == n_features) is_padded = true;
-    if (is_padded) {
-      problem->x[i] = ALLOC_N(LibSvmNode, n_nonzero_features + 1);
+    if (SDX_IS_INDEX(stridx[1])) {
+      x.col_offsets = SDX_GET_INDEX(stridx[1]);
     } else {
-      problem->x[i] = ALLOC_N(LibSvmNode, n_nonzero_features + 2);
+      x.col_stride = SDX_GET_STRIDE(stridx[1]);
     }
-    for (int j = 0, k = 0; j < n_features; j++) {
-      if (x_ptr[i * n_features + j] != 0.0) {
-        problem->x[i][k].index = j + 1;
-        problem->x[i][k].value = x_ptr[i * n_features + j];
-        k++;
+  }
+  return x;
+}
+
+const char* getDenseSampleRowPointer(const LibSvmDenseSamples* const x, const int i) {
+  return x->ptr + (x->row_offsets ? (ssize_t)x->row_offsets[i] : (ssize_t)i * x->row_stride);
+}
+
+template <typename T> bool hasContiguousRows(const LibSvmDenseSamples* const x) {
+  return x->col_offsets == NULL && x->col_stride == (ssize_t)sizeof(T);
+}
+
+/**
+ * Get the elements of the i-th row. The pointer to the row is returned if the elements of the row are contiguous,
+ * or else the elements are gathered into the buffer of n_features elements.
+ */
+template <typename T>
+const T* getDenseSampleRow(const LibSvmDenseSamples* const x, const int i, const int n_features, T* buffer) {
+  const char* const row = getDenseSampleRowPointer(x, i);
+  if (hasContiguousRows<T>(x)) return (const T*)row;
+  if (x->col_offsets) {
+    for (int j = 0; j < n_features; j++) buffer[j] = *(const T*)(row + x->col_offsets[j]);
+  } else {
+    for (int j = 0; j < n_features; j++) buffer[j] = *(const T*)(row + (ssize_t)j * x->col_stride);
+  }
+  return buffer;
+}
+
+#define CONVERSION_ROW_BLOCK 4096
+
+/**
+ * Count the nonzero elements of the row. The count is accumulated without branches so that the compiler vectorizes it.
+ */
+template <typename T> int countNonzeros(const T* const x_row, const int n_features) {
+  int n_nonzeros = 0;
+  for (int j = 0; j < n_features; j++) n_nonzeros += x_row[j] != 0;
+  return n_nonzeros;
+}
+
+template <typename T> struct LibSvmConversionArgs {
+  const LibSvmDenseSamples* x;
+  const double* y_ptr;
+  int n_samples;
+  int n_features;
+  int n_threads;
+  int n_blocks;
+  size_t* block_offsets; /* number of nodes in each block after the first pass, and offset of each block in the second */
+  int* block_first_last; /* first sample with nonzero last feature in each block, or n_samples */
+  T* row_buffers;        /* buffers gathering the rows for each thread, or NULL if the rows are contiguous */
+  int n_padded_samples;
+  LibSvmProblem* problem;
+  LibSvmNode* nodes;
+};
+
+template <typename T> static void* countDenseSamplesWithoutGvl(void* ptr) {
+  LibSvmConversionArgs<T>* const args = (LibSvmConversionArgs<T>*)ptr;
+  const LibSvmDenseSamples* const x = args->x;
+  const int n_samples = args->n_samples;
+  const int n_features = args->n_features;
+  runParallel(args->n_threads, args->n_blocks, [&](const int thread_id, const int block) {
+    const int begin = block * CONVERSION_ROW_BLOCK;
+    const int end = begin + CONVERSION_ROW_BLOCK < n_samples ? begin + CONVERSION_ROW_BLOCK : n_samples;
+    T* const row_buffer = args->row_buffers ? &args->row_buffers[(size_t)thread_id * n_features] : NULL;
+    size_t n_nonzeros = 0;
+    int first_last = n_samples;
+    for (int i = begin; i < end; i++) {
+      const T* const x_row = getDenseSampleRow(x, i, n_features, row_buffer);
+      n_nonzeros += countNonzeros(x_row, n_features);
+      if (first_last == n_samples && n_features > 0 && x_row[n_features - 1] != 0) first_last = i;
+    }
+    args->block_offsets[block + 1] = n_nonzeros;
+    args->block_first_last[block] = first_last;
+  });
+  return NULL;
+}
+
+template <typename T> static void* fillDenseSamplesWithoutGvl(void* ptr) {
+  LibSvmConversionArgs<T>* const args = (LibSvmConversionArgs<T>*)ptr;
+  const LibSvmDenseSamples* const x = args->x;
+  const int n_samples = args->n_samples;
+  const int n_features = args->n_features;
+  const int n_padded_samples = args->n_padded_samples;
+  LibSvmProblem* const problem = args->problem;
+  runParallel(args->n_threads, args->n_blocks, [&](const int thread_id, const int block) {
+    const int begin = block * CONVERSION_ROW_BLOCK;
+    const int end = begin + CONVERSION_ROW_BLOCK < n_samples ? begin + CONVERSION_ROW_BLOCK : n_samples;
+    T* const row_buffer = args->row_buffers ? &args->row_buffers[(size_t)thread_id * n_features] : NULL;
+    LibSvmNode* node = &args->nodes[args->block_offsets[block]];
+    for (int i = begin; i < end; i++) {
+      const T* const x_row = getDenseSampleRow(x, i, n_features, row_buffer);
+      problem->x[i] = node;
+      // The node is always written and only kept for the nonzero element, which avoids unpredictable branches.
+      // The slot after the last nonzero element is overwritten by the padding or the terminator.
+      for (int j = 0; j < n_features; j++) {
+        node->index = j + 1;
+        node->value = (double)x_row[j];
+        node += x_row[j] != 0;
+      }
+      if (i < n_padded_samples) {
+        node->index = n_features;
+        node->value = 0.0;
+        node++;
       }
+      node->index = -1;
+      node->value = 0.0;
+      node++;
+      problem->y[i] = args->y_ptr[i];
     }
-    if (is_padded) {
-      problem->x[i][n_nonzero_features].index = -1;
-      problem->x[i][n_nonzero_features].value = 0.0;
+  });
+  return NULL;
+}
+
+/**
+ * Convert the dense samples to the problem on n_threads threads. The rows are split into blocks of CONVERSION_ROW_BLOCK,
+ * where the nonzero elements are counted in the first pass, and the nodes are filled in the second pass at the offsets
+ * of the blocks given by the prefix sums of the counts. The memory is allocated with the GVL held, and the passes run
+ * without the GVL. The rows of the view whose elements are not contiguous are gathered into the buffer for each thread.
+ */
+template <typename T>
+LibSvmProblem* convertDatasetToLibSvmProblem(const LibSvmDenseSamples* const x, const double* const y_ptr, const int n_samples,
+                                             const int n_features, const int n_threads) {
+  LibSvmConversionArgs<T> args;
+  args.x = x;
+  args.y_ptr = y_ptr;
+  args.n_samples = n_samples;
+  args.n_features = n_features;
+  args.n_threads = n_threads;
+  args.n_blocks = (n_samples + CONVERSION_ROW_BLOCK - 1) / CONVERSION_ROW_BLOCK;
+  const int n_blocks = args.n_blocks;
+  args.block_offsets = ALLOC_N(size_t, n_blocks + 1);
+  args.block_first_last = ALLOC_N(int, n_blocks);
+  args.row_buffers = hasContiguousRows<T>(x) ? NULL : ALLOC_N(T, (size_t)n_threads * n_features);
+  rb_thread_call_without_gvl(countDenseSamplesWithoutGvl<T>, &args, NULL, NULL);
+
+  // The samples before the first one with nonzero last feature end with the node of the last feature index
+  // and zero value, in addition to the terminator.
+  size_t* const block_offsets = args.block_offsets;
+  int n_padded_samples = n_features > 0 ? n_samples : 0;
+  for (int b = 0; b < n_blocks; b++) {
+    if (n_padded_samples > args.block_first_last[b]) n_padded_samples = args.block_first_last[b];
+  }
+  args.n_padded_samples = n_padded_samples;
+  block_offsets[0] = 0;
+  for (int b = 0; b < n_blocks; b++) {
+    const int begin = b * CONVERSION_ROW_BLOCK;
+    const int end = begin + CONVERSION_ROW_BLOCK < n_samples ? begin + CONVERSION_ROW_BLOCK : n_samples;
+    const int n_padded = n_padded_samples < begin ? 0 : (n_padded_samples < end ? n_padded_samples : end) - begin;
+    block_offsets[b + 1] += block_offsets[b] + (end - begin) + n_padded;
+  }
+
+  args.problem = allocLibSvmProblem(n_samples, block_offsets[n_blocks], &args.nodes);
+  rb_thread_call_without_gvl(fillDenseSamplesWithoutGvl<T>, &args, NULL, NULL);
+
+  xfree(args.block_offsets);
+  xfree(args.block_first_last);
+  xfree(args.row_buffers);
+
+  return args.problem;
+}
+
+LibSvmProblem* convertDatasetToLibSvmProblem(VALUE x_val, VALUE y_val, const int n_threads) {
+  narray_t* x_nary;
+  GetNArray(x_val, x_nary);
+  const int n_samples = (int)NA_SHAPE(x_nary)[0];
+  const int n_features = (int)NA_SHAPE(x_nary)[1];
+  const double* const y_ptr = (double*)na_get_pointer_for_read(y_val);
+
+  // The samples of SFloat, Int32, and UInt8 are read directly without casting to DFloat, and the views are read in place.
+  const LibSvmDenseSamples x = getDenseSamples(x_val);
+  LibSvmProblem* problem = NULL;
+  const VALUE x_class = CLASS_OF(x_val);
+  if (x_class == numo_cSFloat) {
+    problem = convertDatasetToLibSvmProblem<float>(&x, y_ptr, n_samples, n_features, n_threads);
+  } else if (x_class == numo_cInt32) {
+    problem = convertDatasetToLibSvmProblem<int32_t>(&x, y_ptr, n_samples, n_features, n_threads);
+  } else if (x_class == numo_cUInt8) {
+    problem = convertDatasetToLibSvmProblem<uint8_t>(&x, y_ptr, n_samples, n_features, n_threads);
+  } else {
+    problem = convertDatasetToLibSvmProblem<double>(&x, y_ptr, n_samples, n_features, n_threads);
+  }
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(y_val);
+
+  return problem;
+}
+
+/**
+ * Copy the elements in [offset, offset + size) of the sample array to the double array.
+ * This is used in prediction to read the samples of SFloat, Int32, and UInt8 block by block.
+ */
+template <typename T> void copySamplesToVectorXd(const void* const arr, const size_t offset, const size_t size, double* vec) {
+  const T* const ptr = (const T*)arr + offset;
+  for (size_t i = 0; i < size; i++) vec[i] = (double)ptr[i];
+}
+
+typedef void (*CopySamplesFunc)(const void* const, const size_t, const size_t, double*);
+
+CopySamplesFunc getCopySamplesFunc(VALUE x_class) {
+  if (x_class == numo_cSFloat) return copySamplesToVectorXd<float>;
+  if (x_class == numo_cInt32) return copySamplesToVectorXd<int32_t>;
+  if (x_class == numo_cUInt8) return copySamplesToVectorXd<uint8_t>;
+  return NULL;
+}
+
+/**
+ * Copy the rows in [begin, begin + n_rows) of the dense samples to the row-major double matrix.
+ * This is used in prediction to read the samples of SFloat, Int32, and UInt8, and the views, block by block.
+ */
+template <typename T>
+void copySampleRowsToMatrixXd(const LibSvmDenseSamples* const x, const int begin, const int n_rows, const int n_features,
+                              double* mat) {
+  for (int r = 0; r < n_rows; r++) {
+    const char* const row = getDenseSampleRowPointer(x, begin + r);
+    double* const mat_row = &mat[(size_t)r * n_features];
+    if (x->col_offsets) {
+      for (int j = 0; j < n_features; j++) mat_row[j] = (double)*(const T*)(row + x->col_offsets[j]);
     } else {
-      problem->x[i][n_nonzero_features].index = n_features;
-      problem->x[i][n_nonzero_features].value = 0.0;
-      problem->x[i][n_nonzero_features + 1].index = -1;
-      problem->x[i][n_nonzero_features + 1].value = 0.0;
+      for (int j = 0; j < n_features; j++) mat_row[j] = (double)*(const T*)(row + (ssize_t)j * x->col_stride);
+    }
+  }
+}
+
+typedef void (*CopySampleRowsFunc)(const LibSvmDenseSamples* const, const int, const int, const int, double*);
+
+/**
+ * Get the function copying the rows of the dense samples to double, or NULL for DFloat samples laid out contiguously,
+ * which are read in place.
+ */
+CopySampleRowsFunc getCopySampleRowsFunc(VALUE x_class, const LibSvmDenseSamples* const x, const int n_features) {
+  if (x_class == numo_cSFloat) return copySampleRowsToMatrixXd<float>;
+  if (x_class == numo_cInt32) return copySampleRowsToMatrixXd<int32_t>;
+  if (x_class == numo_cUInt8) return copySampleRowsToMatrixXd<uint8_t>;
+  if (x->row_offsets || !hasContiguousRows<double>(x) || x->row_stride != (ssize_t)(n_features * sizeof(double))) {
+    return copySampleRowsToMatrixXd<double>;
+  }
+  return NULL;
+}
+
+template <typename T>
+LibSvmProblem* convertCsrMatrixToLibSvmProblem(const int32_t* const indptr, const int32_t* const indices, const T* const values,
+                                               const double* const y_ptr, const int n_samples) {
+  size_t n_nodes = n_samples;
+  for (int32_t k = 0; n_samples > 0 && k < indptr[n_samples]; k++) {
+    if (values[k] != 0) n_nodes++;
+  }
+
+  LibSvmNode* node;
+  LibSvmProblem* problem = allocLibSvmProblem(n_samples, n_nodes, &node);
+  for (int i = 0; i < n_samples; i++) {
+    problem->x[i] = node;
+    for (int32_t k = indptr[i]; k < indptr[i + 1]; k++) {
+      if (values[k] != 0) {
+        node->index = indices[k] + 1;
+        node->value = (double)values[k];
+        node++;
+      }
     }
+    node->index = -1;
+    node->value = 0.0;
+    node++;
     problem->y[i] = y_ptr[i];
   }
 
-  RB_GC_GUARD(x_val);
+  return problem;
+}
+
+LibSvmProblem* convertCsrMatrixToLibSvmProblem(VALUE csr_val, VALUE y_val) {
+  VALUE indptr_val = rb_ary_entry(csr_val, 0);
+  VALUE indices_val = rb_ary_entry(csr_val, 1);
+  VALUE data_val = rb_ary_entry(csr_val, 2);
+  narray_t* indptr_nary;
+  GetNArray(indptr_val, indptr_nary);
+  const int n_samples = (int)NA_SIZE(indptr_nary) - 1;
+  const int32_t* const indptr = (int32_t*)na_get_pointer_for_read(indptr_val);
+  const int32_t* const indices = (int32_t*)na_get_pointer_for_read(indices_val);
+  const double* const y_ptr = (double*)na_get_pointer_for_read(y_val);
+
+  LibSvmProblem* problem = NULL;
+  const VALUE data_class = CLASS_OF(data_val);
+  if (data_class == numo_cSFloat) {
+    problem = convertCsrMatrixToLibSvmProblem(indptr, indices, (float*)na_get_pointer_for_read(data_val), y_ptr, n_samples);
+  } else if (data_class == numo_cInt32) {
+    problem = convertCsrMatrixToLibSvmProblem(indptr, indices, (int32_t*)na_get_pointer_for_read(data_val), y_ptr, n_samples);
+  } else if (data_class == numo_cUInt8) {
+    problem = convertCsrMatrixToLibSvmProblem(indptr, indices, (uint8_t*)na_get_pointer_for_read(data_val), y_ptr, n_samples);
+  } else {
+    problem = convertCsrMatrixToLibSvmProblem(indptr, indices, (double*)na_get_pointer_for_read(data_val), y_ptr, n_samples);
+  }
+
+  RB_GC_GUARD(indptr_val);
+  RB_GC_GUARD(indices_val);
+  RB_GC_GUARD(data_val);
   RB_GC_GUARD(y_val);
 
   return problem;
 }
 
 /** UTILITIES */
-bool isSignleOutputModel(LibSvmModel* model) {
+bool isSignleOutputModel(const LibSvmModel* const model) {
   return (model->param.svm_type == ONE_CLASS || model->param.svm_type == EPSILON_SVR || model->param.svm_type == NU_SVR);
 }
 
-bool isProbabilisticModel(LibSvmModel* model) { return svm_check_probability_model(model) != 0; }
+bool isProbabilisticModel(const LibSvmModel* const model) { return svm_check_probability_model(model) != 0; }
+
+bool isNativeSampleClass(VALUE x_class) {
+  return x_class == numo_cDFloat || x_class == numo_cSFloat || x_class == numo_cInt32 || x_class == numo_cUInt8;
+}
 
 void deleteLibSvmModel(LibSvmModel* model) {
   if (model) {
@@ -434,12 +1012,8 @@ void deleteLibSvmParameter(LibSvmParameter* param) {
 void deleteLibSvmProblem(LibSvmProblem* problem) {
   if (problem) {
     if (problem->x) {
-      for (int i = 0; i < problem->l; i++) {
-        if (problem->x[i]) {
-          xfree(problem->x[i]);
-          problem->x[i] = NULL;
-        }
-      }
+      // The nodes of all samples are held in one buffer allocated by allocLibSvmProblem.
+      if (problem->l > 0) xfree(problem->x[0]);
       xfree(problem->x);
       problem->x = NULL;
     }
@@ -452,263 +1026,2860 @@ void deleteLibSvmProblem(LibSvmProblem* problem) {
   }
 }
 
-/** MODULE FUNCTIONS */
-static VALUE numo_libsvm_train(VALUE self, VALUE x_val, VALUE y_val, VALUE param_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
-  if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
+/**
+ * Copy the model. If share_sv is true, the support vectors of the copy point to the same nodes as those of the source.
+ */
+LibSvmModel* copyLibSvmModel(const LibSvmModel* const src, const bool share_sv) {
+  const int n_classes = src->nr_class;
+  const int n_support_vecs = src->l;
+  const int n_pairs = n_classes * (n_classes - 1) / 2;
+  LibSvmModel* model = ALLOC(LibSvmModel);
+  model->param = src->param;
+  model->param.nr_weight = 0;
+  model->param.weight_label = NULL;
+  model->param.weight = NULL;
+  model->nr_class = n_classes;
+  model->l = n_support_vecs;
+  model->SV = NULL;
+  if (src->SV) {
+    model->SV = ALLOC_N(LibSvmNode*, n_support_vecs);
+    if (share_sv) {
+      memcpy(model->SV, src->SV, n_support_vecs * sizeof(LibSvmNode*));
+    } else {
+      for (int i = 0; i < n_support_vecs; i++) {
+        int n_nodes = 0;
+        while (src->SV[i][n_nodes].index != -1) n_nodes++;
+        model->SV[i] = ALLOC_N(LibSvmNode, n_nodes + 1);
+        memcpy(model->SV[i], src->SV[i], (n_nodes + 1) * sizeof(LibSvmNode));
+      }
+    }
+  }
+  model->sv_coef = NULL;
+  if (src->sv_coef) {
+    model->sv_coef = ALLOC_N(double*, n_classes - 1);
+    for (int i = 0; i < n_classes - 1; i++) {
+      model->sv_coef[i] = ALLOC_N(double, n_support_vecs);
+      memcpy(model->sv_coef[i], src->sv_coef[i], n_support_vecs * sizeof(double));
+    }
+  }
+  model->rho = NULL;
+  if (src->rho) {
+    model->rho = ALLOC_N(double, n_pairs);
+    memcpy(model->rho, src->rho, n_pairs * sizeof(double));
+  }
+  model->probA = NULL;
+  if (src->probA) {
+    model->probA = ALLOC_N(double, n_pairs);
+    memcpy(model->probA, src->probA, n_pairs * sizeof(double));
+  }
+  model->probB = NULL;
+  if (src->probB) {
+    model->probB = ALLOC_N(double, n_pairs);
+    memcpy(model->probB, src->probB, n_pairs * sizeof(double));
+  }
+  model->prob_density_marks = NULL;
+  if (src->prob_density_marks) {
+    model->prob_density_marks = ALLOC_N(double, NR_MARKS);
+    memcpy(model->prob_density_marks, src->prob_density_marks, NR_MARKS * sizeof(double));
+  }
+  model->sv_indices = NULL;
+  if (src->sv_indices) {
+    model->sv_indices = ALLOC_N(int, n_support_vecs);
+    memcpy(model->sv_indices, src->sv_indices, n_support_vecs * sizeof(int));
+  }
+  model->label = NULL;
+  if (src->label) {
+    model->label = ALLOC_N(int, n_classes);
+    memcpy(model->label, src->label, n_classes * sizeof(int));
+  }
+  model->nSV = NULL;
+  if (src->nSV) {
+    model->nSV = ALLOC_N(int, n_classes);
+    memcpy(model->nSV, src->nSV, n_classes * sizeof(int));
+  }
+  model->free_sv = src->free_sv;
+  return model;
+}
 
-  narray_t* x_nary;
-  narray_t* y_nary;
-  GetNArray(x_val, x_nary);
-  GetNArray(y_val, y_nary);
-  if (NA_NDIM(x_nary) != 2) {
-    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
-    return Qnil;
+/** BATCH PREDICTION */
+#define BATCH_ROW_BLOCK 32
+#define BATCH_SV_BLOCK 64
+#define BATCH_FEATURE_BLOCK 256
+
+typedef struct {
+  LibSvmModel* model;
+  double* sv_dense;    /* support vectors as row-major [l, n_sv_features] matrix, or NULL if not used. */
+  double* sv_sq_norms; /* squared norms of support vectors, or NULL if not used. */
+  int n_sv_features;   /* maximum feature index of support vectors */
+  double* linear_weights; /* primal weight vectors of linear kernel model as [n_outputs, n_weight_features], or NULL. */
+  int n_weight_features;
+  VALUE sv_source; /* object holding the nodes of support vectors, or Qnil if the model owns them. */
+} LibSvmModelData;
+
+double powiKernel(double base, int times) {
+  double tmp = base, ret = 1.0;
+  for (int t = times; t > 0; t /= 2) {
+    if (t % 2 == 1) ret *= tmp;
+    tmp = tmp * tmp;
   }
-  if (NA_NDIM(y_nary) != 1) {
-    rb_raise(rb_eArgError, "Expect label or target values to be 1-D arrray.");
-    return Qnil;
+  return ret;
+}
+
+double applyKernelFunction(const LibSvmParameter& param, const double dot, const double x_sq_norm, const double sv_sq_norm) {
+  switch (param.kernel_type) {
+  case POLY:
+    return powiKernel(param.gamma * dot + param.coef0, param.degree);
+  case RBF: {
+    const double sq_dist = x_sq_norm + sv_sq_norm - 2.0 * dot;
+    return exp(-param.gamma * (sq_dist > 0.0 ? sq_dist : 0.0));
   }
-  if (NA_SHAPE(x_nary)[0] != NA_SHAPE(y_nary)[0]) {
-    rb_raise(rb_eArgError, "Expect to have the same number of samples for samples and labels.");
-    return Qnil;
+  case SIGMOID:
+    return tanh(param.gamma * dot + param.coef0);
+  default:
+    return dot;
   }
+}
 
-  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
-  if (!NIL_P(random_seed)) srand(NUM2UINT(random_seed));
+void initLibSvmModelData(LibSvmModelData* data, LibSvmModel* model) {
+  data->model = model;
+  data->sv_dense = NULL;
+  data->sv_sq_norms = NULL;
+  data->n_sv_features = 0;
+  data->linear_weights = NULL;
+  data->n_weight_features = 0;
+  data->sv_source = Qnil;
+}
 
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmProblem* problem = convertDatasetToLibSvmProblem(x_val, y_val);
+/**
+ * Delete the model held by the model data. The nodes of support vectors held by sv_source are not freed.
+ */
+void deleteLibSvmModelOfData(LibSvmModelData* data) {
+  if (data->model && !NIL_P(data->sv_source)) {
+    xfree(data->model->SV);
+    data->model->SV = NULL;
+  }
+  deleteLibSvmModel(data->model);
+  data->model = NULL;
+  data->sv_source = Qnil;
+}
 
-  const char* err_msg = svm_check_parameter(problem, param);
-  if (err_msg) {
-    deleteLibSvmProblem(problem);
-    deleteLibSvmParameter(param);
-    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
-    return Qnil;
+void buildSupportVectorCache(LibSvmModelData* data) {
+  const LibSvmModel* const model = data->model;
+  if (model->SV == NULL || model->sv_coef == NULL || model->l == 0 || model->param.kernel_type == PRECOMPUTED) return;
+
+  // The squared norms of support vectors are computed once here, so that the squared distance in the RBF kernel
+  // is given by the squared norm of the sample computed once per sample and a dot product.
+  size_t n_nonzeros = 0;
+  int n_sv_features = 0;
+  data->sv_sq_norms = ALLOC_N(double, model->l);
+  for (int i = 0; i < model->l; i++) {
+    double sq_norm = 0.0;
+    for (int j = 0; model->SV[i][j].index != -1; j++) {
+      if (model->SV[i][j].index < 1) {
+        // The node with non-positive index is left to svm_predict_values.
+        xfree(data->sv_sq_norms);
+        data->sv_sq_norms = NULL;
+        return;
+      }
+      if (n_sv_features < model->SV[i][j].index) n_sv_features = model->SV[i][j].index;
+      sq_norm += model->SV[i][j].value * model->SV[i][j].value;
+      n_nonzeros++;
+    }
+    data->sv_sq_norms[i] = sq_norm;
+  }
+  data->n_sv_features = n_sv_features;
+  // The dense representation is used only when it does not much exceed the sparse one.
+  if (n_sv_features == 0 || n_nonzeros * 4 < (size_t)model->l * n_sv_features) return;
+
+  data->sv_dense = ALLOC_N(double, (size_t)model->l * n_sv_features);
+  memset(data->sv_dense, 0, (size_t)model->l * n_sv_features * sizeof(double));
+  for (int i = 0; i < model->l; i++) {
+    double* sv_row = &data->sv_dense[(size_t)i * n_sv_features];
+    for (int j = 0; model->SV[i][j].index != -1; j++) sv_row[model->SV[i][j].index - 1] = model->SV[i][j].value;
   }
+}
 
-  VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
-  if (!RTEST(verbose)) svm_set_print_string_function(printNull);
+/**
+ * Build the representation of the model used in prediction: the primal weight vectors for the linear kernel model,
+ * or else the squared norms of support vectors and the dense support vectors if they are dense enough.
+ */
+void buildPredictionCache(LibSvmModelData* data) {
+  data->linear_weights = convertLibSvmModelToLinearWeights(data->model, &data->n_weight_features);
+  if (data->linear_weights == NULL) buildSupportVectorCache(data);
+}
 
-  LibSvmModel* model = svm_train(problem, param);
-  VALUE model_hash = convertLibSvmModelToHash(model);
-  svm_free_and_destroy_model(&model);
+void deletePredictionCache(LibSvmModelData* data) {
+  xfree(data->sv_dense);
+  data->sv_dense = NULL;
+  xfree(data->sv_sq_norms);
+  data->sv_sq_norms = NULL;
+  data->n_sv_features = 0;
+  xfree(data->linear_weights);
+  data->linear_weights = NULL;
+  data->n_weight_features = 0;
+}
 
-  deleteLibSvmProblem(problem);
-  deleteLibSvmParameter(param);
+void calcDenseDotProducts(const double* const x_ptr, const int n_features, const int n_rows, const double* const sv_ptr,
+                          const int n_sv_features, const int n_svs, const int n_cols, double* dot_block) {
+  // dot_block (n_rows x BATCH_SV_BLOCK) accumulates x * sv' over the common feature columns,
+  // where the feature axis is tiled so that the sample and support vector tiles stay in cache.
+  for (int i = 0; i < n_rows * BATCH_SV_BLOCK; i++) dot_block[i] = 0.0;
+  for (int f_begin = 0; f_begin < n_cols; f_begin += BATCH_FEATURE_BLOCK) {
+    const int n_tile_cols = f_begin + BATCH_FEATURE_BLOCK < n_cols ? BATCH_FEATURE_BLOCK : n_cols - f_begin;
+    for (int r = 0; r < n_rows; r++) {
+      const double* const x_row = &x_ptr[(size_t)r * n_features + f_begin];
+      double* dot_row = &dot_block[r * BATCH_SV_BLOCK];
+      for (int s = 0; s < n_svs; s++) dot_row[s] += svm_dense_dot(x_row, &sv_ptr[(size_t)s * n_sv_features + f_begin], n_tile_cols);
+    }
+  }
+}
 
-  RB_GC_GUARD(x_val);
-  RB_GC_GUARD(y_val);
+/**
+ * Buffers used in prediction. These are allocated while holding the GVL,
+ * so that the prediction loops running without the GVL do not call the Ruby allocator.
+ */
+typedef struct {
+  double* x_rows;       /* samples of a row block converted to double: BATCH_ROW_BLOCK * n_features, or NULL if read in place */
+  double* x_scatter;    /* sparse sample scattered to dense array for sparse support vectors: n_scatter */
+  int n_scatter;        /* smaller of n_sv_features and number of columns of samples */
+  LibSvmNode* x_nodes;  /* nodes of a sample: n_features + 1 */
+  double* dec_values;   /* decision values of a row block: BATCH_ROW_BLOCK * n_outputs */
+  int* vote;            /* votes of classes: nr_class */
+  int* sv_group;        /* group of each support vector: l */
+  double* x_sq_norms;   /* squared norms of a row block: BATCH_ROW_BLOCK */
+  double* dot_block;    /* dot products of a row block and a support vector block: BATCH_ROW_BLOCK * BATCH_SV_BLOCK */
+  double* partial_sums; /* sums of coefficient weighted kernel values: BATCH_ROW_BLOCK * n_groups * (nr_class - 1) */
+  double* kvalue;       /* kernel values of a sample for svm_predict_values_with_buffer: l */
+  int* start;           /* start positions of support vectors of classes for svm_predict_values_with_buffer: nr_class */
+  double* prob_buffer;  /* pairwise probabilities and work arrays of probability estimates: nr_class * (2 * nr_class + 1) */
+} LibSvmPredictionBuffer;
+
+int getNumOutputs(const LibSvmModel* const model) {
+  return isSignleOutputModel(model) ? 1 : model->nr_class * (model->nr_class - 1) / 2;
+}
 
-  return model_hash;
+/**
+ * Allocate the buffers for a thread. For the samples given as CSR matrix, n_features is the maximum number of
+ * nonzero elements in a row, n_columns is the number of columns given by the largest column index, and is_sparse
+ * is true. The scattered sample only covers the columns of the samples, so its size does not depend on the largest
+ * index of the support vectors.
+ */
+LibSvmPredictionBuffer* allocPredictionBuffer(const LibSvmModelData* const data, const int n_features, const int n_columns,
+                                              const bool copy_samples, const bool is_sparse) {
+  const LibSvmModel* const model = data->model;
+  LibSvmPredictionBuffer* buffer = ALLOC(LibSvmPredictionBuffer);
+  buffer->x_rows = copy_samples ? ALLOC_N(double, (size_t)BATCH_ROW_BLOCK * n_features) : NULL;
+  buffer->x_scatter = NULL;
+  buffer->n_scatter = 0;
+  if (is_sparse && data->sv_sq_norms && data->sv_dense == NULL) {
+    buffer->n_scatter = n_columns < data->n_sv_features ? n_columns : data->n_sv_features;
+    buffer->x_scatter = ALLOC_N(double, buffer->n_scatter > 0 ? buffer->n_scatter : 1);
+    memset(buffer->x_scatter, 0, buffer->n_scatter * sizeof(double));
+  }
+  buffer->x_nodes = ALLOC_N(LibSvmNode, n_features + 1);
+  buffer->dec_values = ALLOC_N(double, BATCH_ROW_BLOCK * getNumOutputs(model));
+  buffer->vote = ALLOC_N(int, model->nr_class);
+  buffer->sv_group = NULL;
+  buffer->x_sq_norms = NULL;
+  buffer->dot_block = NULL;
+  buffer->partial_sums = NULL;
+  buffer->kvalue = NULL;
+  buffer->start = NULL;
+  buffer->prob_buffer = NULL;
+  if (model->probA && model->probB && !isSignleOutputModel(model)) {
+    buffer->prob_buffer = ALLOC_N(double, (size_t)model->nr_class * (2 * model->nr_class + 1));
+  }
+  if (data->linear_weights == NULL && data->sv_sq_norms == NULL) {
+    buffer->kvalue = ALLOC_N(double, model->l > 0 ? model->l : 1);
+    buffer->start = ALLOC_N(int, model->nr_class);
+  }
+  if (data->sv_sq_norms) {
+    const bool is_single_output = isSignleOutputModel(model);
+    const int n_groups = is_single_output ? 1 : model->nr_class;
+    buffer->sv_group = ALLOC_N(int, model->l);
+    for (int g = 0, s = 0; g < n_groups; g++) {
+      const int n_group_svs = is_single_output ? model->l : model->nSV[g];
+      for (int k = 0; k < n_group_svs; k++) buffer->sv_group[s++] = g;
+    }
+    buffer->x_sq_norms = ALLOC_N(double, BATCH_ROW_BLOCK);
+    if (data->sv_dense) buffer->dot_block = ALLOC_N(double, BATCH_ROW_BLOCK * BATCH_SV_BLOCK);
+    buffer->partial_sums = ALLOC_N(double, BATCH_ROW_BLOCK * n_groups * (model->nr_class - 1));
+  }
+  return buffer;
 }
 
-static VALUE numo_libsvm_cross_validation(VALUE self, VALUE x_val, VALUE y_val, VALUE param_hash, VALUE nr_folds) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
-  if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
+void deletePredictionBuffer(LibSvmPredictionBuffer* buffer) {
+  if (buffer) {
+    xfree(buffer->x_rows);
+    xfree(buffer->x_scatter);
+    xfree(buffer->x_nodes);
+    xfree(buffer->dec_values);
+    xfree(buffer->vote);
+    xfree(buffer->sv_group);
+    xfree(buffer->x_sq_norms);
+    xfree(buffer->dot_block);
+    xfree(buffer->partial_sums);
+    xfree(buffer->kvalue);
+    xfree(buffer->start);
+    xfree(buffer->prob_buffer);
+    xfree(buffer);
+  }
+}
+
+void convertPartialSumsToDecisionValues(const LibSvmModel* const model, const double* const partial_row, double* dec_row) {
+  if (isSignleOutputModel(model)) {
+    dec_row[0] = partial_row[0] - model->rho[0];
+    return;
+  }
+  const int n_classes = model->nr_class;
+  const int n_coefs = n_classes - 1;
+  for (int i = 0, p = 0; i < n_classes; i++) {
+    for (int j = i + 1; j < n_classes; j++, p++) {
+      dec_row[p] = partial_row[i * n_coefs + j - 1] + partial_row[j * n_coefs + i] - model->rho[p];
+    }
+  }
+}
+
+void calcDenseDecisionValues(const LibSvmModelData* const data, const double* const x_ptr, const int n_features, const int begin,
+                             const int end, double* dec_ptr, LibSvmPredictionBuffer* buffer) {
+  const LibSvmModel* const model = data->model;
+  const int n_support_vecs = model->l;
+  const int n_classes = model->nr_class;
+  const bool is_single_output = isSignleOutputModel(model);
+  const int n_groups = is_single_output ? 1 : n_classes;
+  const int n_coefs = n_classes - 1;
+  const int n_outputs = getNumOutputs(model);
+  const int n_sv_features = data->n_sv_features;
+  const int n_cols = n_features < n_sv_features ? n_features : n_sv_features;
+  const int* const sv_group = buffer->sv_group;
+  double* x_sq_norms = buffer->x_sq_norms;
+  double* dot_block = buffer->dot_block;
+  // partial_sums[r][g][m] is the sum of sv_coef[m][s] * K(x_r, sv_s) over the support vectors s in group g.
+  double* partial_sums = buffer->partial_sums;
+
+  for (int r_begin = begin; r_begin < end; r_begin += BATCH_ROW_BLOCK) {
+    const int n_rows = r_begin + BATCH_ROW_BLOCK < end ? BATCH_ROW_BLOCK : end - r_begin;
+    const double* const x_block = &x_ptr[(size_t)r_begin * n_features];
+    for (int r = 0; r < n_rows; r++) {
+      x_sq_norms[r] = svm_dense_dot(&x_block[(size_t)r * n_features], &x_block[(size_t)r * n_features], n_features);
+    }
+    memset(partial_sums, 0, n_rows * n_groups * n_coefs * sizeof(double));
+
+    for (int s_begin = 0; s_begin < n_support_vecs; s_begin += BATCH_SV_BLOCK) {
+      const int n_svs = s_begin + BATCH_SV_BLOCK < n_support_vecs ? BATCH_SV_BLOCK : n_support_vecs - s_begin;
+      calcDenseDotProducts(x_block, n_features, n_rows, &data->sv_dense[(size_t)s_begin * n_sv_features], n_sv_features, n_svs,
+                           n_cols, dot_block);
+      for (int r = 0; r < n_rows; r++) {
+        double* partial_row = &partial_sums[r * n_groups * n_coefs];
+        for (int k = 0; k < n_svs; k++) {
+          const int s = s_begin + k;
+          const double kval = applyKernelFunction(model->param, dot_block[r * BATCH_SV_BLOCK + k], x_sq_norms[r], data->sv_sq_norms[s]);
+          double* partial = &partial_row[sv_group[s] * n_coefs];
+          for (int m = 0; m < n_coefs; m++) partial[m] += model->sv_coef[m][s] * kval;
+        }
+      }
+    }
+
+    for (int r = 0; r < n_rows; r++) {
+      convertPartialSumsToDecisionValues(model, &partial_sums[r * n_groups * n_coefs],
+                                         &dec_ptr[(size_t)(r_begin - begin + r) * n_outputs]);
+    }
+  }
+}
+
+void calcSparseDecisionValues(const LibSvmModelData* const data, const double* const x_ptr, const int n_features,
+                              const int begin, const int end, double* dec_ptr, LibSvmPredictionBuffer* buffer) {
+  const LibSvmModel* const model = data->model;
+  const int n_groups = isSignleOutputModel(model) ? 1 : model->nr_class;
+  const int n_coefs = model->nr_class - 1;
+  const int n_outputs = getNumOutputs(model);
+  const int* const sv_group = buffer->sv_group;
+  double* partial_row = buffer->partial_sums;
+
+  for (int i = begin; i < end; i++) {
+    const double* const x_row = &x_ptr[(size_t)i * n_features];
+    const double x_sq_norm = svm_dense_dot(x_row, x_row, n_features);
+    memset(partial_row, 0, n_groups * n_coefs * sizeof(double));
+    for (int s = 0; s < model->l; s++) {
+      // The sample is dense, so that the dot product only walks the nonzero elements of the support vector.
+      const LibSvmNode* const sv = model->SV[s];
+      double dot = 0.0;
+      for (int k = 0; sv[k].index != -1 && sv[k].index <= n_features; k++) dot += sv[k].value * x_row[sv[k].index - 1];
+      const double kval = applyKernelFunction(model->param, dot, x_sq_norm, data->sv_sq_norms[s]);
+      double* partial = &partial_row[sv_group[s] * n_coefs];
+      for (int m = 0; m < n_coefs; m++) partial[m] += model->sv_coef[m][s] * kval;
+    }
+    convertPartialSumsToDecisionValues(model, partial_row, &dec_ptr[(size_t)(i - begin) * n_outputs]);
+  }
+}
+
+void calcLinearDecisionValues(const LibSvmModelData* const data, const double* const x_ptr, const int n_features,
+                              const int begin, const int end, double* dec_ptr) {
+  const LibSvmModel* const model = data->model;
+  const int n_outputs = getNumOutputs(model);
+  const int n_weight_features = data->n_weight_features;
+  const int n_cols = n_features < n_weight_features ? n_features : n_weight_features;
+  for (int i = begin; i < end; i++) {
+    const double* const x_row = &x_ptr[(size_t)i * n_features];
+    double* dec_row = &dec_ptr[(size_t)(i - begin) * n_outputs];
+    for (int p = 0; p < n_outputs; p++) {
+      const double* const w = &data->linear_weights[(size_t)p * n_weight_features];
+      dec_row[p] = svm_dense_dot(w, x_row, n_cols) - model->rho[p];
+    }
+  }
+}
+
+void calcDecisionValues(const LibSvmModelData* const data, const double* const x_ptr, const int n_features, const int begin,
+                        const int end, double* dec_ptr, LibSvmPredictionBuffer* buffer) {
+  if (data->linear_weights) {
+    calcLinearDecisionValues(data, x_ptr, n_features, begin, end, dec_ptr);
+  } else if (data->sv_dense) {
+    calcDenseDecisionValues(data, x_ptr, n_features, begin, end, dec_ptr, buffer);
+  } else {
+    calcSparseDecisionValues(data, x_ptr, n_features, begin, end, dec_ptr, buffer);
+  }
+}
+
+/**
+ * Calculate the decision values of a sparse sample given by the column indices and values of its nonzero elements.
+ * The cost is O(nnz) for each primal weight vector or support vector in the dense representation,
+ * and O(nnz of support vector) for each sparse support vector with the sample scattered to a dense array.
+ */
+void calcCsrDecisionValues(const LibSvmModelData* const data, const int32_t* const indices, const double* const values,
+                           const int n_nonzeros, double* dec_row, LibSvmPredictionBuffer* buffer) {
+  const LibSvmModel* const model = data->model;
+  if (data->linear_weights) {
+    const int n_weight_features = data->n_weight_features;
+    for (int p = 0; p < getNumOutputs(model); p++) {
+      const double* const w = &data->linear_weights[(size_t)p * n_weight_features];
+      double sum = 0.0;
+      for (int k = 0; k < n_nonzeros && indices[k] < n_weight_features; k++) sum += w[indices[k]] * values[k];
+      dec_row[p] = sum - model->rho[p];
+    }
+    return;
+  }
+
+  const int n_groups = isSignleOutputModel(model) ? 1 : model->nr_class;
+  const int n_coefs = model->nr_class - 1;
+  const int n_sv_features = data->n_sv_features;
+  const int* const sv_group = buffer->sv_group;
+  double* partial_row = buffer->partial_sums;
+  double* x_scatter = buffer->x_scatter;
+  const int n_scatter = buffer->n_scatter;
+
+  double x_sq_norm = 0.0;
+  for (int k = 0; k < n_nonzeros; k++) x_sq_norm += values[k] * values[k];
+  int n_cols = 0;
+  while (n_cols < n_nonzeros && indices[n_cols] < n_sv_features) n_cols++;
+  if (x_scatter) {
+    for (int k = 0; k < n_cols; k++) x_scatter[indices[k]] = values[k];
+  }
+  memset(partial_row, 0, n_groups * n_coefs * sizeof(double));
+  for (int s = 0; s < model->l; s++) {
+    double dot = 0.0;
+    if (data->sv_dense) {
+      const double* const sv_row = &data->sv_dense[(size_t)s * n_sv_features];
+      for (int k = 0; k < n_cols; k++) dot += values[k] * sv_row[indices[k]];
+    } else {
+      const LibSvmNode* const sv = model->SV[s];
+      for (int k = 0; sv[k].index != -1; k++) {
+        if (sv[k].index <= n_scatter) dot += sv[k].value * x_scatter[sv[k].index - 1];
+      }
+    }
+    const double kval = applyKernelFunction(model->param, dot, x_sq_norm, data->sv_sq_norms[s]);
+    double* partial = &partial_row[sv_group[s] * n_coefs];
+    for (int m = 0; m < n_coefs; m++) partial[m] += model->sv_coef[m][s] * kval;
+  }
+  if (x_scatter) {
+    for (int k = 0; k < n_cols; k++) x_scatter[indices[k]] = 0.0;
+  }
+  convertPartialSumsToDecisionValues(model, partial_row, dec_row);
+}
+
+double convertDecisionValuesToLabel(const LibSvmModel* const model, const double* const dec_values, int* vote) {
+  if (isSignleOutputModel(model)) {
+    if (model->param.svm_type == ONE_CLASS) return dec_values[0] > 0 ? 1 : -1;
+    return dec_values[0];
+  }
+  const int n_classes = model->nr_class;
+  for (int i = 0; i < n_classes; i++) vote[i] = 0;
+  for (int i = 0, p = 0; i < n_classes; i++) {
+    for (int j = i + 1; j < n_classes; j++, p++) {
+      if (dec_values[p] > 0) {
+        ++vote[i];
+      } else {
+        ++vote[j];
+      }
+    }
+  }
+  int vote_max_idx = 0;
+  for (int i = 1; i < n_classes; i++) {
+    if (vote[i] > vote[vote_max_idx]) vote_max_idx = i;
+  }
+  return model->label[vote_max_idx];
+}
+
+/** TRAINING AND PREDICTION */
+typedef struct {
+  const LibSvmProblem* problem;
+  const LibSvmParameter* param;
+  const LibSvmModel* init_model; /* model giving the initial dual coefficients for warm start, or NULL. */
+  LibSvmRand* rng;               /* random number generator seeded with random_seed, or NULL. */
+  LibSvmModel* model;
+} LibSvmTrainArgs;
+
+static void* trainLibSvmModelWithoutGvl(void* ptr) {
+  LibSvmTrainArgs* args = (LibSvmTrainArgs*)ptr;
+  args->model = svm_train_rng(args->problem, args->param, args->init_model, args->rng);
+  return NULL;
+}
+
+typedef struct {
+  const LibSvmProblem* problem;
+  const LibSvmParameter* param;
+  int n_folds;
+  LibSvmRand* rng;
+  double* target;
+} LibSvmCrossValidationArgs;
+
+static void* crossValidateLibSvmModelWithoutGvl(void* ptr) {
+  const LibSvmCrossValidationArgs* const args = (const LibSvmCrossValidationArgs*)ptr;
+  svm_cross_validation_rng(args->problem, args->param, args->n_folds, args->target, args->rng);
+  return NULL;
+}
+
+typedef struct {
+  const LibSvmProblem* problem;
+  const LibSvmParameter* params;
+  int n_params;
+  int n_folds;
+  int n_threads;
+  LibSvmRand* rng;
+  double* target;
+} LibSvmGridSearchArgs;
+
+static void* gridSearchLibSvmModelWithoutGvl(void* ptr) {
+  const LibSvmGridSearchArgs* const args = (const LibSvmGridSearchArgs*)ptr;
+  svm_grid_search(args->problem, args->params, args->n_params, args->n_folds, args->n_threads, args->target, args->rng);
+  return NULL;
+}
+
+/**
+ * Cast and check the samples given as 2-D array. The views such as slices and transposes are not copied here,
+ * since they are read in place through the strides or indices in the conversion and prediction.
+ */
+VALUE prepareSamples(VALUE x_val) {
+  if (!isNativeSampleClass(CLASS_OF(x_val))) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
 
   narray_t* x_nary;
-  narray_t* y_nary;
   GetNArray(x_val, x_nary);
-  GetNArray(y_val, y_nary);
   if (NA_NDIM(x_nary) != 2) {
     rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
     return Qnil;
   }
-  if (NA_NDIM(y_nary) != 1) {
-    rb_raise(rb_eArgError, "Expect label or target values to be 1-D arrray.");
-    return Qnil;
+
+  return x_val;
+}
+
+/**
+ * Cast and check the components of CSR matrix, and return them as an array of [indptr, indices, data].
+ * The column indices of each row must be sorted in ascending order as LIBSVM requires.
+ */
+VALUE prepareCsrMatrix(VALUE indptr_val, VALUE indices_val, VALUE data_val) {
+  if (CLASS_OF(indptr_val) != numo_cInt32) indptr_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, indptr_val);
+  if (CLASS_OF(indices_val) != numo_cInt32) indices_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, indices_val);
+  if (!isNativeSampleClass(CLASS_OF(data_val))) data_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, data_val);
+  if (!RTEST(nary_check_contiguous(indptr_val))) indptr_val = nary_dup(indptr_val);
+  if (!RTEST(nary_check_contiguous(indices_val))) indices_val = nary_dup(indices_val);
+  if (!RTEST(nary_check_contiguous(data_val))) data_val = nary_dup(data_val);
+
+  narray_t* indptr_nary;
+  narray_t* indices_nary;
+  narray_t* data_nary;
+  GetNArray(indptr_val, indptr_nary);
+  GetNArray(indices_val, indices_nary);
+  GetNArray(data_val, data_nary);
+  if (NA_NDIM(indptr_nary) != 1 || NA_NDIM(indices_nary) != 1 || NA_NDIM(data_nary) != 1) {
+    rb_raise(rb_eArgError, "Expect indptr, indices, and data of CSR matrix to be 1-D arrays.");
+    return Qnil;
+  }
+  if (NA_SIZE(indices_nary) != NA_SIZE(data_nary)) {
+    rb_raise(rb_eArgError, "Expect indices and data of CSR matrix to have the same number of elements.");
+    return Qnil;
+  }
+
+  const int32_t* const indptr = (int32_t*)na_get_pointer_for_read(indptr_val);
+  const int32_t* const indices = (int32_t*)na_get_pointer_for_read(indices_val);
+  const long n_samples = (long)NA_SIZE(indptr_nary) - 1;
+  const long n_nonzeros = (long)NA_SIZE(indices_nary);
+  bool is_valid_indptr = n_samples >= 0 && indptr[0] == 0 && indptr[n_samples] == n_nonzeros;
+  for (long i = 0; is_valid_indptr && i < n_samples; i++) is_valid_indptr = indptr[i] <= indptr[i + 1];
+  if (!is_valid_indptr) {
+    rb_raise(rb_eArgError, "Expect indptr of CSR matrix to be non-decreasing from 0 to the number of nonzero elements.");
+    return Qnil;
+  }
+  for (long i = 0; i < n_samples; i++) {
+    for (int32_t k = indptr[i]; k < indptr[i + 1]; k++) {
+      if (indices[k] < 0 || indices[k] == INT32_MAX || (k > indptr[i] && indices[k - 1] >= indices[k])) {
+        rb_raise(rb_eArgError, "Expect column indices of CSR matrix to be non-negative and sorted for each row.");
+        return Qnil;
+      }
+    }
+  }
+
+  VALUE csr_val = rb_ary_new2(3);
+  rb_ary_store(csr_val, 0, indptr_val);
+  rb_ary_store(csr_val, 1, indices_val);
+  rb_ary_store(csr_val, 2, data_val);
+  return csr_val;
+}
+
+/**
+ * Get the number of samples given as a 2-D array or CSR matrix prepared by prepareSamples or prepareCsrMatrix.
+ */
+int getNumSamples(VALUE x_val) {
+  narray_t* x_nary;
+  if (RB_TYPE_P(x_val, T_ARRAY)) {
+    GetNArray(rb_ary_entry(x_val, 0), x_nary);
+    return (int)NA_SIZE(x_nary) - 1;
+  }
+  GetNArray(x_val, x_nary);
+  return (int)NA_SHAPE(x_nary)[0];
+}
+
+VALUE prepareLabels(VALUE y_val, const int n_samples) {
+  if (CLASS_OF(y_val) != numo_cDFloat) y_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, y_val);
+  if (!RTEST(nary_check_contiguous(y_val))) y_val = nary_dup(y_val);
+
+  narray_t* y_nary;
+  GetNArray(y_val, y_nary);
+  if (NA_NDIM(y_nary) != 1) {
+    rb_raise(rb_eArgError, "Expect label or target values to be 1-D arrray.");
+    return Qnil;
+  }
+  if ((int)NA_SHAPE(y_nary)[0] != n_samples) {
+    rb_raise(rb_eArgError, "Expect to have the same number of samples for samples and labels.");
+    return Qnil;
+  }
+
+  return y_val;
+}
+
+/**
+ * Convert the samples and labels to the LIBSVM problem. The samples are a 2-D array or CSR matrix
+ * prepared by prepareSamples or prepareCsrMatrix, and the labels are prepared by prepareLabels.
+ * The 2-D array is converted on n_threads threads.
+ */
+LibSvmProblem* convertSamplesToLibSvmProblem(VALUE x_val, VALUE y_val, const int n_threads) {
+  if (RB_TYPE_P(x_val, T_ARRAY)) return convertCsrMatrixToLibSvmProblem(x_val, y_val);
+  return convertDatasetToLibSvmProblem(x_val, y_val, n_threads);
+}
+
+static void numo_libsvm_dataset_free(void* problem) { deleteLibSvmProblem((LibSvmProblem*)problem); }
+
+static size_t numo_libsvm_dataset_size(const void* ptr) {
+  const LibSvmProblem* const problem = (const LibSvmProblem*)ptr;
+  if (problem == NULL) return 0;
+  size_t size = sizeof(*problem) + problem->l * (sizeof(LibSvmNode*) + sizeof(double));
+  for (int i = 0; i < problem->l; i++) {
+    int n_nodes = 0;
+    while (problem->x[i][n_nodes].index != -1) n_nodes++;
+    size += (n_nodes + 1) * sizeof(LibSvmNode);
+  }
+  return size;
+}
+
+static const rb_data_type_t numo_libsvm_dataset_type = {
+  "Numo::Libsvm::Dataset", {NULL, numo_libsvm_dataset_free, numo_libsvm_dataset_size}, NULL, NULL, RUBY_TYPED_FREE_IMMEDIATELY};
+
+bool isLibSvmDataset(VALUE x_val) { return rb_typeddata_is_kind_of(x_val, &numo_libsvm_dataset_type); }
+
+LibSvmProblem* getLibSvmProblemOfDataset(VALUE self) {
+  LibSvmProblem* problem;
+  TypedData_Get_Struct(self, LibSvmProblem, &numo_libsvm_dataset_type, problem);
+  if (problem == NULL) rb_raise(rb_eRuntimeError, "Uninitialized dataset is given.");
+  return problem;
+}
+
+/**
+ * Release the problem used in training, which is the one held by the Dataset object or converted from the samples
+ * and labels. The problem held by the Dataset object is not freed. It is only read in training, so it can be shared
+ * by concurrent calls.
+ */
+void releaseLibSvmProblem(VALUE x_val, LibSvmProblem* problem) {
+  if (!isLibSvmDataset(x_val)) deleteLibSvmProblem(problem);
+}
+
+/**
+ * Check that the model can give the initial dual coefficients for warm start of training on the problem.
+ */
+const char* checkWarmStartModel(const LibSvmProblem* problem, const LibSvmParameter* param, const LibSvmModel* init_model) {
+  if (param->svm_type != C_SVC && param->svm_type != EPSILON_SVR) {
+    return "warm start is only available for C-SVC and epsilon-SVR";
+  }
+  if (init_model->sv_coef == NULL || init_model->sv_indices == NULL) return "sv_coef and sv_indices are required";
+  if (param->svm_type == C_SVC && (init_model->label == NULL || init_model->nSV == NULL)) return "label and nSV are required";
+  for (int i = 0; i < init_model->l; i++) {
+    if (init_model->sv_indices[i] < 1 || init_model->sv_indices[i] > problem->l) {
+      return "sv_indices are out of range of samples";
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Seed the random number generator with the parameter random_seed, and return it, or NULL if the seed is not given.
+ * The generator is given to training instead of seeding rand() with srand, which is shared with the other threads.
+ */
+LibSvmRand* seedLibSvmRand(VALUE param_hash, LibSvmRand* rng) {
+  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
+  if (NIL_P(random_seed)) return NULL;
+  svm_srand(rng, NUM2UINT(random_seed));
+  return rng;
+}
+
+/**
+ * Train the model on the samples prepared by prepareSamples or prepareCsrMatrix, or the Dataset object. If the model
+ * hash is given as init_model_hash, its dual coefficients mapped with sv_indices are the initial point of the solver.
+ * If share_sv is true, the Dataset object must be given, and the support vectors of the model point to its nodes.
+ */
+LibSvmModel* trainLibSvmModel(VALUE x_val, VALUE y_val, VALUE param_hash, VALUE init_model_hash, const bool share_sv) {
+  LibSvmRand rng;
+  LibSvmRand* const rng_ptr = seedLibSvmRand(param_hash, &rng);
+  const int n_jobs = getNumJobs(rb_hash_aref(param_hash, ID2SYM(rb_intern("n_jobs"))));
+
+  // The conversions that may raise are done before the memory is allocated: the Dataset object is checked first,
+  // the initial model is converted next, and the samples and the parameter, which only raise NoMemoryError, last.
+  LibSvmProblem* problem = isLibSvmDataset(x_val) ? getLibSvmProblemOfDataset(x_val) : NULL;
+  LibSvmModel* init_model = NIL_P(init_model_hash) ? NULL : convertHashToLibSvmModel(init_model_hash);
+  if (problem == NULL) problem = convertSamplesToLibSvmProblem(x_val, y_val, n_jobs);
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  param->nr_thread = n_jobs;
+
+  const char* err_msg = svm_check_parameter(problem, param);
+  if (err_msg) {
+    releaseLibSvmProblem(x_val, problem);
+    deleteLibSvmModel(init_model);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
+    return NULL;
+  }
+  if (init_model && (err_msg = checkWarmStartModel(problem, param, init_model)) != NULL) {
+    releaseLibSvmProblem(x_val, problem);
+    deleteLibSvmModel(init_model);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Invalid initial model is given: %s", err_msg);
+    return NULL;
+  }
+
+  VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
+  if (!RTEST(verbose)) svm_set_print_string_function(printNull);
+
+  LibSvmTrainArgs args;
+  args.problem = problem;
+  args.param = param;
+  args.init_model = init_model;
+  args.rng = rng_ptr;
+  args.model = NULL;
+  rb_thread_call_without_gvl(trainLibSvmModelWithoutGvl, &args, NULL, NULL);
+
+  // The support vectors of the trained model point to the nodes of the problem,
+  // so they are copied before the problem is released unless the problem is held by the Dataset object.
+  LibSvmModel* trained_model = args.model;
+  LibSvmModel* model = copyLibSvmModel(trained_model, share_sv);
+  svm_free_and_destroy_model(&trained_model);
+
+  releaseLibSvmProblem(x_val, problem);
+  deleteLibSvmModel(init_model);
+  deleteLibSvmParameter(param);
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(y_val);
+
+  return model;
+}
+
+VALUE crossValidateLibSvmModel(VALUE x_val, VALUE y_val, VALUE param_hash, const int n_folds) {
+  LibSvmRand rng;
+  LibSvmRand* const rng_ptr = seedLibSvmRand(param_hash, &rng);
+
+  const int n_jobs = getNumJobs(rb_hash_aref(param_hash, ID2SYM(rb_intern("n_jobs"))));
+
+  // The samples and the parameter are converted after the Dataset object is checked, since the conversions may raise.
+  LibSvmProblem* problem = isLibSvmDataset(x_val) ? getLibSvmProblemOfDataset(x_val) : NULL;
+  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
+  param->nr_thread = n_jobs;
+  if (problem == NULL) problem = convertSamplesToLibSvmProblem(x_val, y_val, n_jobs);
+
+  const char* err_msg = svm_check_parameter(problem, param);
+  if (err_msg) {
+    releaseLibSvmProblem(x_val, problem);
+    deleteLibSvmParameter(param);
+    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
+    return Qnil;
+  }
+
+  size_t t_shape[1] = {(size_t)(problem->l)};
+  VALUE t_val = rb_narray_new(numo_cDFloat, 1, t_shape);
+  double* t_pt = (double*)na_get_pointer_for_write(t_val);
+
+  VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
+  if (!RTEST(verbose)) svm_set_print_string_function(printNull);
+
+  LibSvmCrossValidationArgs args;
+  args.problem = problem;
+  args.param = param;
+  args.n_folds = n_folds;
+  args.rng = rng_ptr;
+  args.target = t_pt;
+  rb_thread_call_without_gvl(crossValidateLibSvmModelWithoutGvl, &args, NULL, NULL);
+
+  releaseLibSvmProblem(x_val, problem);
+  deleteLibSvmParameter(param);
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(y_val);
+
+  return t_val;
+}
+
+/**
+ * Expand the grid given as a hash of arrays into the parameter hashes of the candidates, merged into the base parameter.
+ * The candidates are the cartesian product of the arrays in the order of the keys, where the last key varies fastest.
+ */
+VALUE expandParameterGrid(VALUE base_param, VALUE grid) {
+  if (!RB_TYPE_P(grid, T_HASH)) {
+    rb_raise(rb_eArgError, "Expect grid to be a Hash.");
+    return Qnil;
+  }
+  // The folds are split once with the type of SVM in the base parameters, so it is not varied by the candidates.
+  if (rb_funcall(grid, rb_intern("key?"), 1, ID2SYM(rb_intern("svm_type"))) == Qtrue) {
+    rb_raise(rb_eArgError, "Expect grid not to have svm_type, which is shared by the candidates.");
+    return Qnil;
+  }
+  VALUE keys = rb_funcall(grid, rb_intern("keys"), 0);
+  const long n_keys = RARRAY_LEN(keys);
+  long n_candidates = 1;
+  for (long k = 0; k < n_keys; k++) {
+    VALUE values = rb_hash_aref(grid, rb_ary_entry(keys, k));
+    if (!RB_TYPE_P(values, T_ARRAY) || RARRAY_LEN(values) == 0) {
+      rb_raise(rb_eArgError, "Expect each value of grid to be a non-empty Array.");
+      return Qnil;
+    }
+    n_candidates *= RARRAY_LEN(values);
+    if (n_candidates > INT_MAX) {
+      rb_raise(rb_eArgError, "Expect grid to have at most %d candidates.", INT_MAX);
+      return Qnil;
+    }
+  }
+
+  VALUE candidates = rb_ary_new2(n_candidates);
+  for (long c = 0; c < n_candidates; c++) {
+    VALUE param_hash = rb_hash_dup(base_param);
+    for (long k = n_keys - 1, r = c; k >= 0; k--) {
+      VALUE key = rb_ary_entry(keys, k);
+      VALUE values = rb_hash_aref(grid, key);
+      rb_hash_aset(param_hash, key, rb_ary_entry(values, r % RARRAY_LEN(values)));
+      r /= RARRAY_LEN(values);
+    }
+    rb_ary_push(candidates, param_hash);
+  }
+
+  return candidates;
+}
+
+static VALUE convertHashToLibSvmParameterProtected(VALUE param_hash) {
+  return (VALUE)convertHashToLibSvmParameter(param_hash);
+}
+
+/**
+ * Convert the parameter and model hashes to the model holding the parameter without the class weights.
+ * The model hash is converted first, and the model is released if the conversion of the parameter hash raises.
+ */
+LibSvmModel* convertHashesToLibSvmModel(VALUE param_hash, VALUE model_hash) {
+  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
+  int state = 0;
+  LibSvmParameter* param = (LibSvmParameter*)rb_protect(convertHashToLibSvmParameterProtected, param_hash, &state);
+  if (state != 0) {
+    deleteLibSvmModel(model);
+    rb_jump_tag(state);
+  }
+  model->param = *param;
+  model->param.nr_weight = 0;
+  model->param.weight_label = NULL;
+  model->param.weight = NULL;
+  deleteLibSvmParameter(param);
+  return model;
+}
+
+/**
+ * Evaluate the candidates with cross validation on the same folds. The score is the accuracy for classification and
+ * one-class SVM, and the negative mean squared error for regression, so that the higher score is the better.
+ * For one-class SVM, the predicted values of +1 or -1 are compared with the labels.
+ */
+VALUE gridSearchLibSvmModel(VALUE x_val, VALUE y_val, VALUE base_param, VALUE grid, const int n_folds) {
+  if (!RB_TYPE_P(base_param, T_HASH)) {
+    rb_raise(rb_eArgError, "Expect base parameter to be a Hash.");
+    return Qnil;
+  }
+  if (n_folds < 2) {
+    rb_raise(rb_eArgError, "Expect number of folds to be greater than or equal to 2.");
+    return Qnil;
+  }
+  VALUE candidates = expandParameterGrid(base_param, grid);
+  const int n_candidates = (int)RARRAY_LEN(candidates);
+
+  LibSvmRand rng;
+  LibSvmRand* const rng_ptr = seedLibSvmRand(base_param, &rng);
+  const int n_jobs = getNumJobs(rb_hash_aref(base_param, ID2SYM(rb_intern("n_jobs"))));
+
+  LibSvmProblem* problem = isLibSvmDataset(x_val) ? getLibSvmProblemOfDataset(x_val) : NULL;
+  LibSvmParameter** params = ALLOC_N(LibSvmParameter*, n_candidates);
+  for (int c = 0; c < n_candidates; c++) {
+    int state = 0;
+    params[c] = (LibSvmParameter*)rb_protect(convertHashToLibSvmParameterProtected, rb_ary_entry(candidates, c), &state);
+    if (state) {
+      // The parameters converted so far are released before the exception is raised again.
+      for (int k = 0; k < c; k++) deleteLibSvmParameter(params[k]);
+      xfree(params);
+      rb_jump_tag(state);
+    }
+  }
+  if (problem == NULL) problem = convertSamplesToLibSvmProblem(x_val, y_val, n_jobs);
+  if (problem->l == 0) {
+    releaseLibSvmProblem(x_val, problem);
+    for (int c = 0; c < n_candidates; c++) deleteLibSvmParameter(params[c]);
+    xfree(params);
+    rb_raise(rb_eArgError, "Expect to have at least one sample.");
+    return Qnil;
+  }
+
+  const char* err_msg = NULL;
+  for (int c = 0; c < n_candidates && err_msg == NULL; c++) err_msg = svm_check_parameter(problem, params[c]);
+  if (err_msg) {
+    releaseLibSvmProblem(x_val, problem);
+    for (int c = 0; c < n_candidates; c++) deleteLibSvmParameter(params[c]);
+    xfree(params);
+    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
+    return Qnil;
+  }
+
+  // The weights of the classes are still owned by the converted parameters.
+  LibSvmParameter* param_list = ALLOC_N(LibSvmParameter, n_candidates);
+  for (int c = 0; c < n_candidates; c++) param_list[c] = *params[c];
+  const int n_samples = problem->l;
+  double* target = ALLOC_N(double, (size_t)n_candidates * n_samples);
+
+  VALUE verbose = rb_hash_aref(base_param, ID2SYM(rb_intern("verbose")));
+  if (!RTEST(verbose)) svm_set_print_string_function(printNull);
+
+  LibSvmGridSearchArgs args;
+  args.problem = problem;
+  args.params = param_list;
+  args.n_params = n_candidates;
+  args.n_folds = n_folds;
+  args.n_threads = n_jobs;
+  args.rng = rng_ptr;
+  args.target = target;
+  rb_thread_call_without_gvl(gridSearchLibSvmModelWithoutGvl, &args, NULL, NULL);
+
+  size_t s_shape[1] = {(size_t)n_candidates};
+  VALUE scores = rb_narray_new(numo_cDFloat, 1, s_shape);
+  double* s_ptr = (double*)na_get_pointer_for_write(scores);
+  const double* const y_ptr = problem->y;
+  int best_index = 0;
+  for (int c = 0; c < n_candidates; c++) {
+    const double* const t_ptr = &target[(size_t)c * n_samples];
+    const bool is_regression = param_list[c].svm_type == EPSILON_SVR || param_list[c].svm_type == NU_SVR;
+    double score = 0.0;
+    for (int i = 0; i < n_samples; i++) {
+      if (is_regression) {
+        score -= (t_ptr[i] - y_ptr[i]) * (t_ptr[i] - y_ptr[i]);
+      } else {
+        score += t_ptr[i] == y_ptr[i] ? 1.0 : 0.0;
+      }
+    }
+    s_ptr[c] = score / n_samples;
+    if (s_ptr[c] > s_ptr[best_index]) best_index = c;
+  }
+
+  xfree(target);
+  xfree(param_list);
+  releaseLibSvmProblem(x_val, problem);
+  for (int c = 0; c < n_candidates; c++) deleteLibSvmParameter(params[c]);
+  xfree(params);
+
+  VALUE result = rb_hash_new();
+  rb_hash_aset(result, ID2SYM(rb_intern("params")), candidates);
+  rb_hash_aset(result, ID2SYM(rb_intern("scores")), scores);
+  rb_hash_aset(result, ID2SYM(rb_intern("best_index")), INT2NUM(best_index));
+  rb_hash_aset(result, ID2SYM(rb_intern("best_param")), rb_ary_entry(candidates, best_index));
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(y_val);
+
+  return result;
+}
+
+enum { PREDICT_LABEL, PREDICT_DECISION_VALUES, PREDICT_PROBABILITY };
+
+typedef struct {
+  const LibSvmModelData* data;
+  LibSvmDenseSamples samples;   /* dense samples */
+  CopySampleRowsFunc copy_rows; /* function converting the rows of dense samples to double, or NULL if read in place */
+  const void* x_ptr;            /* values of the nonzero elements of CSR matrix */
+  CopySamplesFunc copy_samples; /* function converting the values to double, or NULL for DFloat */
+  const int32_t* indptr;        /* row pointers of CSR matrix, or NULL for dense samples */
+  const int32_t* indices;       /* column indices of CSR matrix */
+  double* y_ptr;
+  int n_samples;
+  int n_features; /* number of features, or maximum number of nonzero elements in a row of CSR matrix */
+  int n_columns;  /* number of features, or number of columns given by the largest column index of CSR matrix */
+  int type; /* PREDICT_LABEL, PREDICT_DECISION_VALUES, or PREDICT_PROBABILITY */
+  int n_threads;
+  LibSvmPredictionBuffer** buffers; /* buffers for each thread */
+} LibSvmPredictionArgs;
+
+void predictLibSvmCsrRows(const LibSvmPredictionArgs* const args, LibSvmPredictionBuffer* buffer, const int begin,
+                          const int end) {
+  const LibSvmModelData* const data = args->data;
+  const LibSvmModel* const model = data->model;
+  const int32_t* const indptr = args->indptr;
+  double* y_ptr = args->y_ptr;
+  const int n_outputs = getNumOutputs(model);
+
+  for (int r_begin = begin; r_begin < end; r_begin += BATCH_ROW_BLOCK) {
+    const int r_end = r_begin + BATCH_ROW_BLOCK < end ? r_begin + BATCH_ROW_BLOCK : end;
+    const double* values = NULL;
+    if (args->copy_samples) {
+      args->copy_samples(args->x_ptr, indptr[r_begin], indptr[r_end] - indptr[r_begin], buffer->x_rows);
+      values = buffer->x_rows;
+    } else {
+      values = &((const double*)args->x_ptr)[indptr[r_begin]];
+    }
+
+    for (int i = r_begin; i < r_end; i++) {
+      const int32_t* const row_indices = &args->indices[indptr[i]];
+      const double* const row_values = &values[indptr[i] - indptr[r_begin]];
+      const int n_nonzeros = indptr[i + 1] - indptr[i];
+      double* dec_values = args->type == PREDICT_DECISION_VALUES ? &y_ptr[(size_t)i * n_outputs] : buffer->dec_values;
+      double label = 0.0;
+      if (data->linear_weights == NULL && data->sv_sq_norms == NULL) {
+        int n = 0;
+        for (int k = 0; k < n_nonzeros; k++) {
+          if (row_values[k] != 0.0) {
+            buffer->x_nodes[n].index = row_indices[k] + 1;
+            buffer->x_nodes[n].value = row_values[k];
+            n++;
+          }
+        }
+        buffer->x_nodes[n].index = -1;
+        buffer->x_nodes[n].value = 0.0;
+        label = svm_predict_values_with_buffer(model, buffer->x_nodes, dec_values, buffer->kvalue, buffer->start, buffer->vote);
+      } else {
+        calcCsrDecisionValues(data, row_indices, row_values, n_nonzeros, dec_values, buffer);
+        if (args->type == PREDICT_LABEL) label = convertDecisionValuesToLabel(model, dec_values, buffer->vote);
+      }
+      if (args->type == PREDICT_PROBABILITY) {
+        svm_predict_probability_from_dec_values_with_buffer(model, dec_values, &y_ptr[(size_t)i * model->nr_class],
+                                                            buffer->prob_buffer);
+      } else if (args->type == PREDICT_LABEL) {
+        y_ptr[i] = label;
+      }
+    }
+  }
+}
+
+void predictLibSvmRows(const LibSvmPredictionArgs* const args, LibSvmPredictionBuffer* buffer, const int begin, const int end) {
+  if (args->indptr) {
+    predictLibSvmCsrRows(args, buffer, begin, end);
+    return;
+  }
+
+  const LibSvmModelData* const data = args->data;
+  const LibSvmModel* const model = data->model;
+  const int n_features = args->n_features;
+  double* y_ptr = args->y_ptr;
+  const int n_outputs = getNumOutputs(model);
+
+  for (int r_begin = begin; r_begin < end; r_begin += BATCH_ROW_BLOCK) {
+    const int n_rows = r_begin + BATCH_ROW_BLOCK < end ? BATCH_ROW_BLOCK : end - r_begin;
+    const double* x_rows = NULL;
+    if (args->copy_rows) {
+      args->copy_rows(&args->samples, r_begin, n_rows, n_features, buffer->x_rows);
+      x_rows = buffer->x_rows;
+    } else {
+      x_rows = (const double*)getDenseSampleRowPointer(&args->samples, r_begin);
+    }
+
+    if (data->linear_weights == NULL && data->sv_sq_norms == NULL) {
+      // The sample nodes and the work arrays of LIBSVM are taken from the buffer, so that no memory is allocated for each sample.
+      for (int r = 0; r < n_rows; r++) {
+        const int i = r_begin + r;
+        copyVectorXdToLibSvmNode(&x_rows[(size_t)r * n_features], n_features, buffer->x_nodes);
+        double* dec_values = args->type == PREDICT_DECISION_VALUES ? &y_ptr[(size_t)i * n_outputs] : buffer->dec_values;
+        const double label =
+          svm_predict_values_with_buffer(model, buffer->x_nodes, dec_values, buffer->kvalue, buffer->start, buffer->vote);
+        if (args->type == PREDICT_PROBABILITY) {
+          svm_predict_probability_from_dec_values_with_buffer(model, dec_values, &y_ptr[(size_t)i * model->nr_class],
+                                                              buffer->prob_buffer);
+        } else if (args->type == PREDICT_LABEL) {
+          y_ptr[i] = label;
+        }
+      }
+    } else if (args->type == PREDICT_DECISION_VALUES) {
+      calcDecisionValues(data, x_rows, n_features, 0, n_rows, &y_ptr[(size_t)r_begin * n_outputs], buffer);
+    } else {
+      calcDecisionValues(data, x_rows, n_features, 0, n_rows, buffer->dec_values, buffer);
+      for (int r = 0; r < n_rows; r++) {
+        const int i = r_begin + r;
+        const double* const dec_values = &buffer->dec_values[r * n_outputs];
+        if (args->type == PREDICT_PROBABILITY) {
+          svm_predict_probability_from_dec_values_with_buffer(model, dec_values, &y_ptr[(size_t)i * model->nr_class],
+                                                              buffer->prob_buffer);
+        } else {
+          y_ptr[i] = convertDecisionValuesToLabel(model, dec_values, buffer->vote);
+        }
+      }
+    }
+  }
+}
+
+static void* predictLibSvmRowsWithoutGvl(void* ptr) {
+  const LibSvmPredictionArgs* const args = (const LibSvmPredictionArgs*)ptr;
+  // The rows are split into chunks of several row blocks that are processed by the threads in parallel.
+  const int chunk_size = 4 * BATCH_ROW_BLOCK;
+  const int n_chunks = (args->n_samples + chunk_size - 1) / chunk_size;
+  runParallel(args->n_threads, n_chunks, [args, chunk_size](const int thread_id, const int chunk) {
+    const int begin = chunk * chunk_size;
+    const int end = begin + chunk_size < args->n_samples ? begin + chunk_size : args->n_samples;
+    predictLibSvmRows(args, args->buffers[thread_id], begin, end);
+  });
+  return NULL;
+}
+
+void runPrediction(VALUE x_val, VALUE y_val, const LibSvmModelData* const data, const int type, const int n_jobs) {
+  LibSvmPredictionArgs args;
+  args.data = data;
+  args.y_ptr = (double*)na_get_pointer_for_write(y_val);
+  args.n_samples = getNumSamples(x_val);
+  args.type = type;
+  VALUE data_val = Qnil;
+  if (RB_TYPE_P(x_val, T_ARRAY)) {
+    data_val = rb_ary_entry(x_val, 2);
+    args.indptr = (int32_t*)na_get_pointer_for_read(rb_ary_entry(x_val, 0));
+    args.indices = (int32_t*)na_get_pointer_for_read(rb_ary_entry(x_val, 1));
+    args.n_features = 0;
+    args.n_columns = 0;
+    for (int i = 0; i < args.n_samples; i++) {
+      if (args.n_features < args.indptr[i + 1] - args.indptr[i]) args.n_features = args.indptr[i + 1] - args.indptr[i];
+      // The column indices of each row are sorted, so the last one is the largest in the row.
+      if (args.indptr[i + 1] > args.indptr[i] && args.n_columns <= args.indices[args.indptr[i + 1] - 1]) {
+        args.n_columns = args.indices[args.indptr[i + 1] - 1] + 1;
+      }
+    }
+    args.x_ptr = na_get_pointer_for_read(data_val);
+    args.copy_samples = getCopySamplesFunc(CLASS_OF(data_val));
+    args.copy_rows = NULL;
+  } else {
+    narray_t* x_nary;
+    GetNArray(x_val, x_nary);
+    args.indptr = NULL;
+    args.indices = NULL;
+    args.n_features = (int)NA_SHAPE(x_nary)[1];
+    args.n_columns = args.n_features;
+    args.samples = getDenseSamples(x_val);
+    args.copy_rows = getCopySampleRowsFunc(CLASS_OF(x_val), &args.samples, args.n_features);
+    args.x_ptr = NULL;
+    args.copy_samples = NULL;
+  }
+  const int max_threads = (args.n_samples + BATCH_ROW_BLOCK - 1) / BATCH_ROW_BLOCK;
+  args.n_threads = n_jobs < max_threads ? n_jobs : max_threads;
+  if (args.n_threads < 1) args.n_threads = 1;
+  args.buffers = ALLOC_N(LibSvmPredictionBuffer*, args.n_threads);
+  for (int t = 0; t < args.n_threads; t++) {
+    args.buffers[t] = allocPredictionBuffer(data, args.n_features, args.n_columns,
+                                            args.copy_samples != NULL || args.copy_rows != NULL, args.indptr != NULL);
+  }
+
+  rb_thread_call_without_gvl(predictLibSvmRowsWithoutGvl, &args, NULL, NULL);
+
+  for (int t = 0; t < args.n_threads; t++) deletePredictionBuffer(args.buffers[t]);
+  xfree(args.buffers);
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(data_val);
+  RB_GC_GUARD(y_val);
+}
+
+VALUE predictLibSvmModel(VALUE x_val, const LibSvmModelData* const data, const int n_jobs) {
+  size_t y_shape[1] = {(size_t)getNumSamples(x_val)};
+  VALUE y_val = rb_narray_new(numo_cDFloat, 1, y_shape);
+
+  runPrediction(x_val, y_val, data, PREDICT_LABEL, n_jobs);
+
+  return y_val;
+}
+
+VALUE decisionFunctionLibSvmModel(VALUE x_val, const LibSvmModelData* const data, const int n_jobs) {
+  const LibSvmModel* const model = data->model;
+  size_t y_shape[2] = {(size_t)getNumSamples(x_val), (size_t)getNumOutputs(model)};
+  const int n_dims = isSignleOutputModel(model) ? 1 : 2;
+  VALUE y_val = rb_narray_new(numo_cDFloat, n_dims, y_shape);
+
+  runPrediction(x_val, y_val, data, PREDICT_DECISION_VALUES, n_jobs);
+
+  return y_val;
+}
+
+VALUE predictProbaLibSvmModel(VALUE x_val, const LibSvmModelData* const data, const int n_jobs) {
+  const LibSvmModel* const model = data->model;
+  if (!isProbabilisticModel(model)) return Qnil;
+
+  size_t y_shape[2] = {(size_t)getNumSamples(x_val), (size_t)(model->nr_class)};
+  VALUE y_val = rb_narray_new(numo_cDFloat, 2, y_shape);
+
+  runPrediction(x_val, y_val, data, PREDICT_PROBABILITY, n_jobs);
+
+  return y_val;
+}
+
+VALUE predictLibSvmModel(VALUE x_val, const LibSvmModelData* const data, const int type, const int n_jobs) {
+  switch (type) {
+  case PREDICT_DECISION_VALUES:
+    return decisionFunctionLibSvmModel(x_val, data, n_jobs);
+  case PREDICT_PROBABILITY:
+    return predictProbaLibSvmModel(x_val, data, n_jobs);
+  default:
+    return predictLibSvmModel(x_val, data, n_jobs);
+  }
+}
+
+/**
+ * Predict with the model given as the parameter and model hashes, where the samples are prepared
+ * by prepareSamples or prepareCsrMatrix.
+ */
+VALUE predictLibSvmModelHash(VALUE x_val, VALUE param_hash, VALUE model_hash, const int type) {
+  const int n_jobs = getNumJobs(rb_hash_aref(param_hash, ID2SYM(rb_intern("n_jobs"))));
+
+  LibSvmModelData data;
+  initLibSvmModelData(&data, convertHashesToLibSvmModel(param_hash, model_hash));
+  buildPredictionCache(&data);
+
+  VALUE y_val = predictLibSvmModel(x_val, &data, type, n_jobs);
+
+  deletePredictionCache(&data);
+  deleteLibSvmModel(data.model);
+
+  RB_GC_GUARD(x_val);
+
+  return y_val;
+}
+
+/** MODEL FILES */
+typedef struct {
+  char* ptr;
+  size_t size;
+  bool mapped; /* true if ptr is the file mapped into memory, or false if it is allocated with malloc */
+} LibSvmModelMemory;
+
+void freeModelMemoryContent(LibSvmModelMemory* memory) {
+  if (memory->ptr == NULL) return;
+#ifndef _WIN32
+  if (memory->mapped) munmap(memory->ptr, memory->size);
+#endif
+  if (!memory->mapped) free(memory->ptr);
+  memory->ptr = NULL;
+  memory->size = 0;
+}
+
+static void numo_libsvm_model_memory_free(void* ptr) {
+  freeModelMemoryContent((LibSvmModelMemory*)ptr);
+  xfree(ptr);
+}
+
+static size_t numo_libsvm_model_memory_size(const void* ptr) {
+  return sizeof(LibSvmModelMemory) + ((const LibSvmModelMemory*)ptr)->size;
+}
+
+static const rb_data_type_t numo_libsvm_model_memory_type = {
+  "Numo::Libsvm::ModelMemory", {NULL, numo_libsvm_model_memory_free, numo_libsvm_model_memory_size}, NULL, NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY};
+
+/**
+ * Create the hidden object holding the memory of the model file or model arrays, which is released with the object.
+ */
+VALUE newModelMemory(LibSvmModelMemory** memory) {
+  *memory = ALLOC(LibSvmModelMemory);
+  (*memory)->ptr = NULL;
+  (*memory)->size = 0;
+  (*memory)->mapped = false;
+  return TypedData_Wrap_Struct(0, &numo_libsvm_model_memory_type, *memory);
+}
+
+VALUE allocModelMemory(const size_t size, char** ptr) {
+  LibSvmModelMemory* memory;
+  VALUE memory_val = newModelMemory(&memory);
+  memory->ptr = (char*)malloc(size > 0 ? size : 1);
+  if (memory->ptr == NULL) rb_memerror();
+  memory->size = size;
+  *ptr = memory->ptr;
+  return memory_val;
+}
+
+/**
+ * Release the memory held by the object before the object is garbage collected.
+ */
+void releaseModelMemory(VALUE memory_val) { freeModelMemoryContent((LibSvmModelMemory*)RTYPEDDATA_DATA(memory_val)); }
+
+/**
+ * Map the file into memory as read-only, so that its pages are shared by the processes loading the same file.
+ * On Windows, the file is read into memory instead. Qnil is returned on failure.
+ */
+VALUE mapModelFile(const char* const filename) {
+  LibSvmModelMemory* file;
+  VALUE file_val = newModelMemory(&file);
+#ifdef _WIN32
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL) return Qnil;
+  if (_fseeki64(fp, 0, SEEK_END) == 0) {
+    const long long size = _ftelli64(fp);
+    if (size > 0 && _fseeki64(fp, 0, SEEK_SET) == 0) file->ptr = (char*)malloc((size_t)size);
+    if (file->ptr && fread(file->ptr, 1, (size_t)size, fp) == (size_t)size) file->size = (size_t)size;
+  }
+  fclose(fp);
+  return file->size > 0 ? file_val : Qnil;
+#else
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return Qnil;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr != MAP_FAILED) {
+      file->ptr = (char*)ptr;
+      file->size = (size_t)st.st_size;
+      file->mapped = true;
+    }
+  }
+  close(fd);
+  return file->ptr ? file_val : Qnil;
+#endif
+}
+
+static const char* const svm_type_names[] = {"c_svc", "nu_svc", "one_class", "epsilon_svr", "nu_svr", NULL};
+static const char* const kernel_type_names[] = {"linear", "polynomial", "rbf", "sigmoid", "precomputed", NULL};
+
+bool isModelFileSpace(const char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+
+const char* skipModelFileSpaces(const char* p, const char* const end) {
+  while (p < end && isModelFileSpace(*p)) p++;
+  return p;
+}
+
+bool isModelFileDelimiter(const char* const p, const char* const end) { return p == end || isModelFileSpace(*p); }
+
+/**
+ * Parse the decimal integer in [p, end), and return the pointer to the character following it, or NULL on failure.
+ */
+const char* parseModelFileInt(const char* p, const char* const end, int* value) {
+  const bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) p++;
+  const char* const digits = p;
+  long long v = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    v = v * 10 + (*p - '0');
+    if (v > (long long)INT_MAX + 1) return NULL;
+  }
+  if (p == digits) return NULL;
+  v = negative ? -v : v;
+  if (v > INT_MAX) return NULL;
+  *value = (int)v;
+  return p;
+}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+/**
+ * Get the value that strtod gives for the number in [p, end) out of the range of double, which is HUGE_VAL
+ * if the magnitude of the number is greater than one, or zero otherwise, with the sign of the number.
+ */
+double getOutOfRangeModelFileDouble(const char* p, const char* const end) {
+  const bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) p++;
+  long long exponent = 0;
+  bool has_nonzero = false;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    has_nonzero = has_nonzero || *p != '0';
+    if (has_nonzero) exponent++;
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (!has_nonzero && *p == '0') exponent--;
+      has_nonzero = has_nonzero || *p != '0';
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    const bool negative_exp = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    long long exp = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (exp < 1000000000LL) exp = exp * 10 + (*p - '0');
+    }
+    exponent += negative_exp ? -exp : exp;
+  }
+  const double value = exponent > 0 ? HUGE_VAL : 0.0;
+  return negative ? -value : value;
+}
+
+const char* parseModelFileDoubleInCLocale(const char* const begin, const char* const end, double* value) {
+  const char* const first = begin < end && *begin == '+' ? begin + 1 : begin;
+  const std::from_chars_result res = std::from_chars(first, end, *value);
+  if (res.ec == std::errc::result_out_of_range) *value = getOutOfRangeModelFileDouble(first, res.ptr);
+  return res.ec == std::errc() || res.ec == std::errc::result_out_of_range ? res.ptr : NULL;
+}
+#else
+#ifdef _WIN32
+typedef _locale_t LibSvmLocale;
+LibSvmLocale getCLocale() {
+  static const LibSvmLocale c_locale = _create_locale(LC_ALL, "C");
+  return c_locale;
+}
+#define strtod_l _strtod_l
+#else
+typedef locale_t LibSvmLocale;
+LibSvmLocale getCLocale() {
+  static const LibSvmLocale c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+  return c_locale;
+}
+#endif
+
+const char* parseModelFileDoubleInCLocale(const char* const begin, const char* const end, double* value) {
+  char buffer[128];
+  size_t len = 0;
+  while (begin + len < end && len < sizeof(buffer) - 1 && !isModelFileSpace(begin[len]) && begin[len] != ':') {
+    buffer[len] = begin[len];
+    len++;
+  }
+  buffer[len] = '\0';
+  char* endptr;
+  *value = strtod_l(buffer, &endptr, getCLocale());
+  return endptr == buffer ? NULL : begin + (endptr - buffer);
+}
+#endif
+
+/**
+ * Parse the decimal floating-point number in [p, end) without depending on the locale, and return the pointer to
+ * the character following it, or NULL on failure. The number with at most 19 significant digits whose mantissa and
+ * power of ten are exactly representable, such as the values of support vectors formatted with "%.8g", is converted
+ * with one correctly rounded multiplication or division. The others are converted with std::from_chars,
+ * or strtod_l in the C locale if it is not available.
+ */
+const char* parseModelFileDouble(const char* const begin, const char* const end, double* value) {
+  static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* p = begin;
+  const bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) p++;
+  uint64_t mantissa = 0;
+  int n_digits = 0;
+  int n_significant_digits = 0;
+  int exponent = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++, n_digits++) {
+    if (mantissa == 0 && *p == '0') continue;
+    if (++n_significant_digits <= 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, n_digits++) {
+      if (mantissa == 0 && *p == '0') {
+        exponent--;
+      } else if (++n_significant_digits <= 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (n_digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    const bool negative_exp = q < end && *q == '-';
+    if (q < end && (*q == '-' || *q == '+')) q++;
+    int exp = 0;
+    const char* const exp_digits = q;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) {
+      if (exp < 100000) exp = exp * 10 + (*q - '0');
+    }
+    if (q > exp_digits) {
+      exponent += negative_exp ? -exp : exp;
+      p = q;
+    }
+  }
+  const bool is_exact = n_significant_digits <= 19 && mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22;
+  if (n_digits == 0 || (mantissa != 0 && !is_exact)) return parseModelFileDoubleInCLocale(begin, end, value);
+  double v = (double)mantissa;
+  if (mantissa != 0) v = exponent < 0 ? v / powers_of_ten[-exponent] : v * powers_of_ten[exponent];
+  *value = negative ? -v : v;
+  return p;
+}
+
+/**
+ * Get the next token separated by white spaces in [*p, end), and advance *p to the end of the token.
+ */
+bool nextModelFileToken(const char** p, const char* const end, const char** token, size_t* token_len) {
+  *token = skipModelFileSpaces(*p, end);
+  const char* q = *token;
+  while (q < end && !isModelFileSpace(*q)) q++;
+  *token_len = q - *token;
+  *p = q;
+  return *token_len > 0;
+}
+
+bool isModelFileToken(const char* const token, const size_t token_len, const char* const word) {
+  return token_len == strlen(word) && memcmp(token, word, token_len) == 0;
+}
+
+bool parseModelFileNames(const char** p, const char* const end, const char* const* names, int* value) {
+  const char* token;
+  size_t token_len;
+  if (!nextModelFileToken(p, end, &token, &token_len)) return false;
+  for (int i = 0; names[i]; i++) {
+    if (isModelFileToken(token, token_len, names[i])) {
+      *value = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseModelFileValues(const char** p, const char* const end, const int n, int* values) {
+  for (int i = 0; i < n; i++) {
+    const char* token;
+    size_t token_len;
+    if (!nextModelFileToken(p, end, &token, &token_len)) return false;
+    if (parseModelFileInt(token, *p, &values[i]) != *p) return false;
+  }
+  return true;
+}
+
+bool parseModelFileValues(const char** p, const char* const end, const int n, double* values) {
+  for (int i = 0; i < n; i++) {
+    const char* token;
+    size_t token_len;
+    if (!nextModelFileToken(p, end, &token, &token_len)) return false;
+    if (parseModelFileDouble(token, *p, &values[i]) != *p) return false;
+  }
+  return true;
+}
+
+template <typename T> bool parseModelFileArray(const char** p, const char* const end, const int n, T** values) {
+  if (n < 0) return false;
+  xfree(*values);
+  *values = ALLOC_N(T, n);
+  return parseModelFileValues(p, end, n, *values);
+}
+
+/**
+ * Parse the header of the LIBSVM text model file in [*p, end) as read_model_header in svm.cpp does,
+ * and advance *p to the line following "SV". Return false if the header is not valid.
+ */
+bool parseLibSvmModelHeader(const char** p, const char* const end, LibSvmModel* model) {
+  for (;;) {
+    const char* token;
+    size_t token_len;
+    if (!nextModelFileToken(p, end, &token, &token_len)) return false;
+    const int n_pairs = model->nr_class * (model->nr_class - 1) / 2;
+    bool ok = true;
+    if (isModelFileToken(token, token_len, "svm_type")) {
+      ok = parseModelFileNames(p, end, svm_type_names, &model->param.svm_type);
+    } else if (isModelFileToken(token, token_len, "kernel_type")) {
+      ok = parseModelFileNames(p, end, kernel_type_names, &model->param.kernel_type);
+    } else if (isModelFileToken(token, token_len, "degree")) {
+      ok = parseModelFileValues(p, end, 1, &model->param.degree);
+    } else if (isModelFileToken(token, token_len, "gamma")) {
+      ok = parseModelFileValues(p, end, 1, &model->param.gamma);
+    } else if (isModelFileToken(token, token_len, "coef0")) {
+      ok = parseModelFileValues(p, end, 1, &model->param.coef0);
+    } else if (isModelFileToken(token, token_len, "nr_class")) {
+      // The number of classes is limited so that the number of pairs of classes does not overflow.
+      ok = parseModelFileValues(p, end, 1, &model->nr_class) && model->nr_class >= 1 && model->nr_class <= 46341;
+    } else if (isModelFileToken(token, token_len, "total_sv")) {
+      ok = parseModelFileValues(p, end, 1, &model->l) && model->l >= 0;
+    } else if (isModelFileToken(token, token_len, "rho")) {
+      ok = parseModelFileArray(p, end, n_pairs, &model->rho);
+    } else if (isModelFileToken(token, token_len, "label")) {
+      ok = parseModelFileArray(p, end, model->nr_class, &model->label);
+    } else if (isModelFileToken(token, token_len, "probA")) {
+      ok = parseModelFileArray(p, end, n_pairs, &model->probA);
+    } else if (isModelFileToken(token, token_len, "probB")) {
+      ok = parseModelFileArray(p, end, n_pairs, &model->probB);
+    } else if (isModelFileToken(token, token_len, "prob_density_marks")) {
+      ok = parseModelFileArray(p, end, NR_MARKS, &model->prob_density_marks);
+    } else if (isModelFileToken(token, token_len, "nr_sv")) {
+      ok = parseModelFileArray(p, end, model->nr_class, &model->nSV);
+    } else if (isModelFileToken(token, token_len, "SV")) {
+      const char* const eol = (const char*)memchr(*p, '\n', end - *p);
+      *p = eol ? eol + 1 : end;
+      return true;
+    } else {
+      ok = false;
+    }
+    if (!ok) return false;
+  }
+}
+
+/**
+ * Parse the line of a support vector in [p, end), which has n_coefs coefficients followed by n_nodes - 1 pairs of
+ * index and value, into the i-th coefficients and the nodes.
+ */
+bool parseLibSvmModelLine(const char* p, const char* const end, const int n_coefs, double** sv_coef, const int i,
+                          LibSvmNode* nodes, const size_t n_nodes) {
+  for (int k = 0; k < n_coefs; k++) {
+    p = parseModelFileDouble(skipModelFileSpaces(p, end), end, &sv_coef[k][i]);
+    if (p == NULL || !isModelFileDelimiter(p, end)) return false;
+  }
+  size_t n = 0;
+  for (p = skipModelFileSpaces(p, end); p < end; p = skipModelFileSpaces(p, end), n++) {
+    if (n + 1 >= n_nodes) return false;
+    p = parseModelFileInt(p, end, &nodes[n].index);
+    if (p == NULL || p == end || *p != ':') return false;
+    p = parseModelFileDouble(p + 1, end, &nodes[n].value);
+    if (p == NULL || !isModelFileDelimiter(p, end)) return false;
+  }
+  if (n + 1 != n_nodes) return false;
+  nodes[n].index = -1;
+  nodes[n].value = 0.0;
+  return true;
+}
+
+/**
+ * Check that the model loaded from the file has the arrays used in prediction.
+ */
+bool isValidLoadedModel(const LibSvmModel* const model) {
+  if (model->nr_class < 1 || model->rho == NULL) return false;
+  if (model->param.svm_type != C_SVC && model->param.svm_type != NU_SVC) return true;
+  if (model->label == NULL || model->nSV == NULL) return false;
+  long long n_total_svs = 0;
+  for (int i = 0; i < model->nr_class; i++) {
+    if (model->nSV[i] < 0) return false;
+    n_total_svs += model->nSV[i];
+  }
+  return n_total_svs == model->l;
+}
+
+#define MODEL_FILE_LINE_BLOCK 1024
+
+typedef struct {
+  const char** lines; /* beginnings of the lines of support vectors, followed by the end of the last line */
+  size_t* offsets;    /* number of nodes of each line after counting, and offset of each line in the nodes after that */
+  LibSvmModel* model;
+  LibSvmNode* nodes;
+  int n_support_vecs;
+  int n_threads;
+  bool failed;
+} LibSvmModelTextArgs;
+
+static void* countLibSvmModelNodesWithoutGvl(void* ptr) {
+  LibSvmModelTextArgs* const args = (LibSvmModelTextArgs*)ptr;
+  const int n_support_vecs = args->n_support_vecs;
+  const int n_blocks = (n_support_vecs + MODEL_FILE_LINE_BLOCK - 1) / MODEL_FILE_LINE_BLOCK;
+  runParallel(args->n_threads, n_blocks, [args, n_support_vecs](const int thread_id, const int block) {
+    const int begin = block * MODEL_FILE_LINE_BLOCK;
+    const int end = begin + MODEL_FILE_LINE_BLOCK < n_support_vecs ? begin + MODEL_FILE_LINE_BLOCK : n_support_vecs;
+    for (int i = begin; i < end; i++) {
+      size_t n_nodes = 1;
+      for (const char* c = args->lines[i]; c < args->lines[i + 1]; c++) n_nodes += *c == ':';
+      args->offsets[i + 1] = n_nodes;
+    }
+  });
+  return NULL;
+}
+
+static void* parseLibSvmModelLinesWithoutGvl(void* ptr) {
+  LibSvmModelTextArgs* const args = (LibSvmModelTextArgs*)ptr;
+  LibSvmModel* const model = args->model;
+  const int n_coefs = model->nr_class - 1;
+  const int n_support_vecs = args->n_support_vecs;
+  const int n_blocks = (n_support_vecs + MODEL_FILE_LINE_BLOCK - 1) / MODEL_FILE_LINE_BLOCK;
+  std::atomic<bool> failed(false);
+  runParallel(args->n_threads, n_blocks, [&](const int thread_id, const int block) {
+    const int begin = block * MODEL_FILE_LINE_BLOCK;
+    const int end = begin + MODEL_FILE_LINE_BLOCK < n_support_vecs ? begin + MODEL_FILE_LINE_BLOCK : n_support_vecs;
+    const char* const* const lines = args->lines;
+    const size_t* const offsets = args->offsets;
+    for (int i = begin; i < end && !failed.load(std::memory_order_relaxed); i++) {
+      model->SV[i] = &args->nodes[offsets[i]];
+      if (!parseLibSvmModelLine(lines[i], lines[i + 1], n_coefs, model->sv_coef, i, model->SV[i],
+                                offsets[i + 1] - offsets[i])) {
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  });
+  args->failed = failed.load();
+  return NULL;
+}
+
+/**
+ * Load the model from the LIBSVM text model file as svm_load_model does, without switching the global locale.
+ * The file is mapped into memory and the lines of support vectors are found. Then the nodes of each line are counted,
+ * and the lines are parsed in blocks of MODEL_FILE_LINE_BLOCK on n_threads threads into the node arena held by the
+ * hidden object given as sv_source. The memory is allocated with the GVL held, and the lines are counted and parsed
+ * without the GVL. NULL is returned on failure.
+ */
+LibSvmModel* loadLibSvmModelText(const char* const filename, const int n_threads, VALUE* sv_source) {
+  VALUE file_val = mapModelFile(filename);
+  if (NIL_P(file_val)) return NULL;
+  const LibSvmModelMemory* const file = (const LibSvmModelMemory*)RTYPEDDATA_DATA(file_val);
+  const char* p = file->ptr;
+  const char* const eof = file->ptr + file->size;
+
+  LibSvmModel* model = ALLOC(LibSvmModel);
+  memset(model, 0, sizeof(LibSvmModel));
+  model->param.nr_thread = 1;
+  if (!parseLibSvmModelHeader(&p, eof, model) || !isValidLoadedModel(model)) {
+    deleteLibSvmModel(model);
+    releaseModelMemory(file_val);
+    return NULL;
+  }
+
+  const int n_coefs = model->nr_class - 1;
+  const int n_support_vecs = model->l;
+  const char** lines = ALLOC_N(const char*, n_support_vecs + 1);
+  for (int i = 0; i < n_support_vecs; i++) {
+    lines[i] = p;
+    const char* const eol = (const char*)memchr(p, '\n', eof - p);
+    p = eol ? eol + 1 : eof;
+  }
+  lines[n_support_vecs] = p;
+
+  LibSvmModelTextArgs args;
+  args.lines = lines;
+  args.offsets = ALLOC_N(size_t, n_support_vecs + 1);
+  args.model = model;
+  args.n_support_vecs = n_support_vecs;
+  args.n_threads = n_threads;
+  args.failed = false;
+  rb_thread_call_without_gvl(countLibSvmModelNodesWithoutGvl, &args, NULL, NULL);
+  size_t* const offsets = args.offsets;
+  offsets[0] = 0;
+  for (int i = 0; i < n_support_vecs; i++) offsets[i + 1] += offsets[i];
+
+  char* arena;
+  VALUE arena_val = allocModelMemory(offsets[n_support_vecs] * sizeof(LibSvmNode), &arena);
+  args.nodes = (LibSvmNode*)arena;
+  model->sv_coef = ALLOC_N(double*, n_coefs);
+  for (int k = 0; k < n_coefs; k++) model->sv_coef[k] = ALLOC_N(double, n_support_vecs);
+  model->SV = ALLOC_N(LibSvmNode*, n_support_vecs);
+  rb_thread_call_without_gvl(parseLibSvmModelLinesWithoutGvl, &args, NULL, NULL);
+  model->free_sv = 1;
+
+  xfree(lines);
+  xfree(offsets);
+  releaseModelMemory(file_val);
+  if (args.failed) {
+    xfree(model->SV);
+    model->SV = NULL;
+    deleteLibSvmModel(model);
+    releaseModelMemory(arena_val);
+    return NULL;
+  }
+
+  *sv_source = arena_val;
+  RB_GC_GUARD(arena_val);
+
+  return model;
+}
+
+#define MODEL_FILE_INT_LEN 11
+#define MODEL_FILE_DOUBLE_LEN 32
+#define MODEL_FILE_WRITE_ROUND 64
+
+char* formatModelFileInt(char* p, const int value) {
+  char digits[MODEL_FILE_INT_LEN];
+  unsigned int v = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+  int n_digits = 0;
+  do {
+    digits[n_digits++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v > 0);
+  if (value < 0) *p++ = '-';
+  while (n_digits > 0) *p++ = digits[--n_digits];
+  return p;
+}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+/**
+ * Format the value with the shortest representation that is parsed back to the same value, which is read as the value
+ * formatted with "%.17g" is.
+ */
+char* formatModelFileDouble(char* p, const double value) { return std::to_chars(p, p + MODEL_FILE_DOUBLE_LEN, value).ptr; }
+
+/**
+ * Format the value of a node as "%.8g" does in the C locale.
+ */
+char* formatModelFileNodeValue(char* p, const double value) {
+  return std::to_chars(p, p + MODEL_FILE_DOUBLE_LEN, value, std::chars_format::general, 8).ptr;
+}
+#else
+/**
+ * Format the value with snprintf, and replace the decimal point of the current locale with '.'.
+ */
+char* formatModelFileDoubleWithPrecision(char* p, const double value, const int precision) {
+  char* const end = p + snprintf(p, MODEL_FILE_DOUBLE_LEN, "%.*g", precision, value);
+  char* q = p;
+  while (q < end && ((*q >= '0' && *q <= '9') || *q == '-' || *q == '+')) q++;
+  if (q == p || q[-1] < '0' || q[-1] > '9' || q == end || *q == 'e' || *q == 'E' || *q == '.') return end;
+  char* r = q;
+  while (r < end && !(*r >= '0' && *r <= '9') && *r != 'e' && *r != 'E') r++;
+  *q = '.';
+  memmove(q + 1, r, end - r);
+  return q + 1 + (end - r);
+}
+
+char* formatModelFileDouble(char* p, const double value) { return formatModelFileDoubleWithPrecision(p, value, 17); }
+
+char* formatModelFileNodeValue(char* p, const double value) { return formatModelFileDoubleWithPrecision(p, value, 8); }
+#endif
+
+void writeModelFileValues(FILE* fp, const char* const name, const int n, const int* const values) {
+  char buffer[MODEL_FILE_INT_LEN + 1];
+  fputs(name, fp);
+  for (int i = 0; i < n; i++) {
+    buffer[0] = ' ';
+    fwrite(buffer, 1, formatModelFileInt(buffer + 1, values[i]) - buffer, fp);
+  }
+  fputc('\n', fp);
+}
+
+void writeModelFileValues(FILE* fp, const char* const name, const int n, const double* const values) {
+  char buffer[MODEL_FILE_DOUBLE_LEN + 1];
+  fputs(name, fp);
+  for (int i = 0; i < n; i++) {
+    buffer[0] = ' ';
+    fwrite(buffer, 1, formatModelFileDouble(buffer + 1, values[i]) - buffer, fp);
+  }
+  fputc('\n', fp);
+}
+
+/**
+ * Get the upper bound of the length of the i-th line of support vectors formatted with formatLibSvmModelLine.
+ */
+size_t getLibSvmModelLineBound(const LibSvmModel* const model, const int i) {
+  size_t n_nodes = 1;
+  if (model->param.kernel_type != PRECOMPUTED) {
+    for (n_nodes = 0; model->SV[i][n_nodes].index != -1; n_nodes++)
+      ;
+  }
+  return (size_t)(model->nr_class - 1) * (MODEL_FILE_DOUBLE_LEN + 1) +
+         n_nodes * (MODEL_FILE_INT_LEN + MODEL_FILE_DOUBLE_LEN + 2) + 1;
+}
+
+/**
+ * Format the i-th line of support vectors as svm_save_model does, and return the pointer following the line.
+ */
+char* formatLibSvmModelLine(char* p, const LibSvmModel* const model, const int i) {
+  for (int k = 0; k < model->nr_class - 1; k++) {
+    p = formatModelFileDouble(p, model->sv_coef[k][i]);
+    *p++ = ' ';
+  }
+  if (model->param.kernel_type == PRECOMPUTED) {
+    *p++ = '0';
+    *p++ = ':';
+    p = formatModelFileInt(p, (int)model->SV[i][0].value);
+    *p++ = ' ';
+  } else {
+    for (const LibSvmNode* node = model->SV[i]; node->index != -1; node++) {
+      p = formatModelFileInt(p, node->index);
+      *p++ = ':';
+      p = formatModelFileNodeValue(p, node->value);
+      *p++ = ' ';
+    }
+  }
+  *p++ = '\n';
+  return p;
+}
+
+typedef struct {
+  const LibSvmModel* model;
+  size_t* block_bounds; /* upper bound of the length of each block of lines */
+  char* buffer;         /* buffer of the lines of MODEL_FILE_WRITE_ROUND blocks */
+  FILE* fp;
+  int n_threads;
+} LibSvmModelTextWriterArgs;
+
+static void* boundLibSvmModelLinesWithoutGvl(void* ptr) {
+  LibSvmModelTextWriterArgs* const args = (LibSvmModelTextWriterArgs*)ptr;
+  const LibSvmModel* const model = args->model;
+  const int n_support_vecs = model->l;
+  const int n_blocks = (n_support_vecs + MODEL_FILE_LINE_BLOCK - 1) / MODEL_FILE_LINE_BLOCK;
+  runParallel(args->n_threads, n_blocks, [args, model, n_support_vecs](const int thread_id, const int block) {
+    const int begin = block * MODEL_FILE_LINE_BLOCK;
+    const int end = begin + MODEL_FILE_LINE_BLOCK < n_support_vecs ? begin + MODEL_FILE_LINE_BLOCK : n_support_vecs;
+    size_t bound = 0;
+    for (int i = begin; i < end; i++) bound += getLibSvmModelLineBound(model, i);
+    args->block_bounds[block] = bound;
+  });
+  return NULL;
+}
+
+static void* writeLibSvmModelLinesWithoutGvl(void* ptr) {
+  LibSvmModelTextWriterArgs* const args = (LibSvmModelTextWriterArgs*)ptr;
+  const LibSvmModel* const model = args->model;
+  const int n_support_vecs = model->l;
+  const int n_blocks = (n_support_vecs + MODEL_FILE_LINE_BLOCK - 1) / MODEL_FILE_LINE_BLOCK;
+  char* const buffer = args->buffer;
+  size_t block_offsets[MODEL_FILE_WRITE_ROUND + 1];
+  size_t block_lengths[MODEL_FILE_WRITE_ROUND];
+  for (int round_begin = 0; round_begin < n_blocks; round_begin += MODEL_FILE_WRITE_ROUND) {
+    const int n_round_blocks =
+      round_begin + MODEL_FILE_WRITE_ROUND < n_blocks ? MODEL_FILE_WRITE_ROUND : n_blocks - round_begin;
+    block_offsets[0] = 0;
+    for (int b = 0; b < n_round_blocks; b++) {
+      block_offsets[b + 1] = block_offsets[b] + args->block_bounds[round_begin + b];
+    }
+    runParallel(args->n_threads, n_round_blocks, [&](const int thread_id, const int b) {
+      const int begin = (round_begin + b) * MODEL_FILE_LINE_BLOCK;
+      const int end = begin + MODEL_FILE_LINE_BLOCK < n_support_vecs ? begin + MODEL_FILE_LINE_BLOCK : n_support_vecs;
+      char* p = &buffer[block_offsets[b]];
+      for (int i = begin; i < end; i++) p = formatLibSvmModelLine(p, model, i);
+      block_lengths[b] = p - &buffer[block_offsets[b]];
+    });
+    for (int b = 0; b < n_round_blocks; b++) fwrite(&buffer[block_offsets[b]], 1, block_lengths[b], args->fp);
+  }
+  return NULL;
+}
+
+/**
+ * Save the model to the LIBSVM text model file that svm_load_model reads, without switching the global locale.
+ * The values of the header and the coefficients are formatted with the shortest representation that is parsed back
+ * to the same values, and the nodes are formatted as svm_save_model does. The lines of support vectors are formatted
+ * in blocks of MODEL_FILE_LINE_BLOCK on n_threads threads into a buffer, which is written in order every
+ * MODEL_FILE_WRITE_ROUND blocks. The lines are measured, formatted, and written without the GVL.
+ */
+bool saveLibSvmModelText(const char* const filename, const LibSvmModel* const model, const int n_threads) {
+  const int n_classes = model->nr_class;
+  const int n_pairs = n_classes * (n_classes - 1) / 2;
+  const int n_blocks = (model->l + MODEL_FILE_LINE_BLOCK - 1) / MODEL_FILE_LINE_BLOCK;
+  size_t* block_bounds = ALLOC_N(size_t, n_blocks + 1);
+  LibSvmModelTextWriterArgs args;
+  args.model = model;
+  args.block_bounds = block_bounds;
+  args.n_threads = n_threads;
+  rb_thread_call_without_gvl(boundLibSvmModelLinesWithoutGvl, &args, NULL, NULL);
+  size_t buffer_size = 1;
+  for (int round_begin = 0; round_begin < n_blocks; round_begin += MODEL_FILE_WRITE_ROUND) {
+    size_t round_size = 0;
+    for (int block = round_begin; block < n_blocks && block < round_begin + MODEL_FILE_WRITE_ROUND; block++) {
+      round_size += block_bounds[block];
+    }
+    if (buffer_size < round_size) buffer_size = round_size;
+  }
+
+  char* buffer = ALLOC_N(char, buffer_size);
+  FILE* fp = fopen(filename, "w");
+  if (fp == NULL) {
+    xfree(buffer);
+    xfree(block_bounds);
+    return false;
+  }
+
+  const LibSvmParameter& param = model->param;
+  fprintf(fp, "svm_type %s\n", svm_type_names[param.svm_type]);
+  fprintf(fp, "kernel_type %s\n", kernel_type_names[param.kernel_type]);
+  if (param.kernel_type == POLY) writeModelFileValues(fp, "degree", 1, &param.degree);
+  if (param.kernel_type == POLY || param.kernel_type == RBF || param.kernel_type == SIGMOID) {
+    writeModelFileValues(fp, "gamma", 1, &param.gamma);
+  }
+  if (param.kernel_type == POLY || param.kernel_type == SIGMOID) writeModelFileValues(fp, "coef0", 1, &param.coef0);
+  writeModelFileValues(fp, "nr_class", 1, &model->nr_class);
+  writeModelFileValues(fp, "total_sv", 1, &model->l);
+  writeModelFileValues(fp, "rho", n_pairs, model->rho);
+  if (model->label) writeModelFileValues(fp, "label", n_classes, model->label);
+  if (model->probA) writeModelFileValues(fp, "probA", n_pairs, model->probA);
+  if (model->probB) writeModelFileValues(fp, "probB", n_pairs, model->probB);
+  if (model->prob_density_marks) writeModelFileValues(fp, "prob_density_marks", NR_MARKS, model->prob_density_marks);
+  if (model->nSV) writeModelFileValues(fp, "nr_sv", n_classes, model->nSV);
+  fputs("SV\n", fp);
+
+  args.buffer = buffer;
+  args.fp = fp;
+  rb_thread_call_without_gvl(writeLibSvmModelLinesWithoutGvl, &args, NULL, NULL);
+
+  xfree(buffer);
+  xfree(block_bounds);
+  const bool failed = ferror(fp) != 0;
+  return fclose(fp) == 0 && !failed;
+}
+
+#define BINARY_MODEL_MAGIC "NUMOSVM"
+#define BINARY_MODEL_VERSION 1
+#define BINARY_MODEL_BYTE_ORDER 0x01020304
+#define BINARY_MODEL_ALIGNMENT 64
+
+enum {
+  BINARY_RHO,
+  BINARY_PROB_A,
+  BINARY_PROB_B,
+  BINARY_PROB_DENSITY_MARKS,
+  BINARY_LABEL,
+  BINARY_N_SV,
+  BINARY_SV_INDICES,
+  BINARY_SV_COEF,
+  BINARY_SV_OFFSETS,
+  BINARY_SV_NODES,
+  N_BINARY_SECTIONS
+};
+
+/**
+ * The header of the binary model file. It is followed by the sections of the model arrays, each of which begins at
+ * the offset aligned to BINARY_MODEL_ALIGNMENT bytes. The offset of the absent array is 0. The support vectors are
+ * given by the offsets of the rows, [l + 1] uint64_t, and the nodes in the native layout of svm_node.
+ */
+typedef struct {
+  char magic[8];                       /* BINARY_MODEL_MAGIC */
+  uint32_t version;                    /* BINARY_MODEL_VERSION */
+  uint32_t byte_order;                 /* BINARY_MODEL_BYTE_ORDER written in the native byte order */
+  uint32_t node_size;                  /* sizeof(LibSvmNode) */
+  int32_t svm_type;
+  int32_t kernel_type;
+  int32_t degree;
+  double gamma;
+  double coef0;
+  double cache_size;
+  double eps;
+  double C;
+  double nu;
+  double p;
+  int32_t shrinking;
+  int32_t probability;
+  int32_t nr_class;
+  int32_t l;
+  uint64_t n_nodes;                    /* total number of nodes of support vectors including terminators */
+  uint64_t offsets[N_BINARY_SECTIONS]; /* byte offsets of sections from the beginning of the file */
+} LibSvmBinaryModelHeader;
+
+/**
+ * Set the sections of the model to the header, and return the size of the binary model file.
+ */
+uint64_t layoutBinaryLibSvmModel(const LibSvmModel* const model, LibSvmBinaryModelHeader* header) {
+  const uint64_t n_classes = model->nr_class;
+  const uint64_t n_support_vecs = model->l;
+  const uint64_t n_pairs = n_classes * (n_classes - 1) / 2;
+  uint64_t n_nodes = 0;
+  for (int i = 0; model->SV && i < model->l; i++) {
+    int n_row_nodes = 1;
+    while (model->SV[i][n_row_nodes - 1].index != -1) n_row_nodes++;
+    n_nodes += n_row_nodes;
+  }
+  const void* const sections[N_BINARY_SECTIONS] = {model->rho,   model->probA, model->probB,      model->prob_density_marks,
+                                                   model->label, model->nSV,   model->sv_indices, model->sv_coef,
+                                                   model->SV,    model->SV};
+  const uint64_t section_sizes[N_BINARY_SECTIONS] = {n_pairs * sizeof(double),
+                                                     n_pairs * sizeof(double),
+                                                     n_pairs * sizeof(double),
+                                                     NR_MARKS * sizeof(double),
+                                                     n_classes * sizeof(int32_t),
+                                                     n_classes * sizeof(int32_t),
+                                                     n_support_vecs * sizeof(int32_t),
+                                                     (n_classes - 1) * n_support_vecs * sizeof(double),
+                                                     (n_support_vecs + 1) * sizeof(uint64_t),
+                                                     n_nodes * sizeof(LibSvmNode)};
+
+  memset(header, 0, sizeof(LibSvmBinaryModelHeader));
+  memcpy(header->magic, BINARY_MODEL_MAGIC, sizeof(BINARY_MODEL_MAGIC));
+  header->version = BINARY_MODEL_VERSION;
+  header->byte_order = BINARY_MODEL_BYTE_ORDER;
+  header->node_size = sizeof(LibSvmNode);
+  header->svm_type = model->param.svm_type;
+  header->kernel_type = model->param.kernel_type;
+  header->degree = model->param.degree;
+  header->gamma = model->param.gamma;
+  header->coef0 = model->param.coef0;
+  header->cache_size = model->param.cache_size;
+  header->eps = model->param.eps;
+  header->C = model->param.C;
+  header->nu = model->param.nu;
+  header->p = model->param.p;
+  header->shrinking = model->param.shrinking;
+  header->probability = model->param.probability;
+  header->nr_class = model->nr_class;
+  header->l = model->l;
+  header->n_nodes = n_nodes;
+  uint64_t file_size = sizeof(LibSvmBinaryModelHeader);
+  for (int s = 0; s < N_BINARY_SECTIONS; s++) {
+    if (sections[s] == NULL) continue;
+    file_size = (file_size + BINARY_MODEL_ALIGNMENT - 1) / BINARY_MODEL_ALIGNMENT * BINARY_MODEL_ALIGNMENT;
+    header->offsets[s] = file_size;
+    file_size += section_sizes[s];
+  }
+  return file_size;
+}
+
+typedef struct {
+  FILE* fp;      /* file to write, or NULL to write to buffer */
+  char* buffer;  /* memory to write if fp is NULL */
+  uint64_t size; /* size of buffer */
+  uint64_t pos;  /* number of bytes written so far */
+  bool ok;
+} LibSvmBinaryModelWriter;
+
+void writeBinaryModelBytes(LibSvmBinaryModelWriter* writer, const void* const ptr, const size_t size) {
+  if (writer->ok && size > 0) {
+    if (writer->fp) {
+      writer->ok = fwrite(ptr, 1, size, writer->fp) == size;
+    } else {
+      writer->ok = writer->pos + size <= writer->size;
+      if (writer->ok) memcpy(writer->buffer + writer->pos, ptr, size);
+    }
+  }
+  writer->pos += size;
+}
+
+void writeBinaryModelSection(LibSvmBinaryModelWriter* writer, const uint64_t offset, const void* const ptr, const size_t size) {
+  static const char zeros[BINARY_MODEL_ALIGNMENT] = {0};
+  if (offset == 0) return;
+  if (offset < writer->pos || offset - writer->pos >= BINARY_MODEL_ALIGNMENT) {
+    writer->ok = false;
+    return;
+  }
+  writeBinaryModelBytes(writer, zeros, offset - writer->pos);
+  writeBinaryModelBytes(writer, ptr, size);
+}
+
+/**
+ * Write the header and the sections of the model laid out with layoutBinaryLibSvmModel.
+ */
+void writeBinaryLibSvmModel(LibSvmBinaryModelWriter* writer, const LibSvmModel* const model,
+                            const LibSvmBinaryModelHeader* const header) {
+  const size_t n_pairs = (size_t)model->nr_class * (model->nr_class - 1) / 2;
+  const uint64_t* const offsets = header->offsets;
+  writeBinaryModelBytes(writer, header, sizeof(LibSvmBinaryModelHeader));
+  writeBinaryModelSection(writer, offsets[BINARY_RHO], model->rho, n_pairs * sizeof(double));
+  writeBinaryModelSection(writer, offsets[BINARY_PROB_A], model->probA, n_pairs * sizeof(double));
+  writeBinaryModelSection(writer, offsets[BINARY_PROB_B], model->probB, n_pairs * sizeof(double));
+  writeBinaryModelSection(writer, offsets[BINARY_PROB_DENSITY_MARKS], model->prob_density_marks, NR_MARKS * sizeof(double));
+  writeBinaryModelSection(writer, offsets[BINARY_LABEL], model->label, model->nr_class * sizeof(int32_t));
+  writeBinaryModelSection(writer, offsets[BINARY_N_SV], model->nSV, model->nr_class * sizeof(int32_t));
+  writeBinaryModelSection(writer, offsets[BINARY_SV_INDICES], model->sv_indices, model->l * sizeof(int32_t));
+  for (int i = 0; model->sv_coef && i < model->nr_class - 1; i++) {
+    const uint64_t offset = offsets[BINARY_SV_COEF] + (uint64_t)i * model->l * sizeof(double);
+    writeBinaryModelSection(writer, offset, model->sv_coef[i], model->l * sizeof(double));
+  }
+  if (model->SV) {
+    uint64_t n_nodes = 0;
+    writeBinaryModelSection(writer, offsets[BINARY_SV_OFFSETS], &n_nodes, sizeof(uint64_t));
+    for (int i = 0; i < model->l; i++) {
+      int n_row_nodes = 1;
+      while (model->SV[i][n_row_nodes - 1].index != -1) n_row_nodes++;
+      n_nodes += n_row_nodes;
+      writeBinaryModelBytes(writer, &n_nodes, sizeof(uint64_t));
+    }
+    // The nodes are copied to the zero-initialized buffer so that the padding bytes of svm_node are written as zeros.
+    LibSvmNode* buffer = ALLOC_N(LibSvmNode, CONVERSION_ROW_BLOCK);
+    memset(buffer, 0, CONVERSION_ROW_BLOCK * sizeof(LibSvmNode));
+    writeBinaryModelSection(writer, offsets[BINARY_SV_NODES], NULL, 0);
+    int n_buffered = 0;
+    for (int i = 0; i < model->l; i++) {
+      for (int j = 0;; j++) {
+        buffer[n_buffered].index = model->SV[i][j].index;
+        buffer[n_buffered].value = model->SV[i][j].value;
+        if (++n_buffered == CONVERSION_ROW_BLOCK) {
+          writeBinaryModelBytes(writer, buffer, n_buffered * sizeof(LibSvmNode));
+          n_buffered = 0;
+        }
+        if (model->SV[i][j].index == -1) break;
+      }
+    }
+    writeBinaryModelBytes(writer, buffer, n_buffered * sizeof(LibSvmNode));
+    xfree(buffer);
+  }
+}
+
+/**
+ * Save the model to the binary model file that can be loaded with loadBinaryLibSvmModel. Return false on failure.
+ * Since the models loaded from the file read the support vectors from its mapped pages, the file is not rewritten
+ * in place. The model is written to a temporary file in the same directory, which is synced and renamed over
+ * the file, so that the loaded models keep reading the old file. On Windows, the file is written directly,
+ * as it is read into memory on loading.
+ */
+bool saveBinaryLibSvmModel(const char* const filename, const LibSvmModel* const model) {
+  LibSvmBinaryModelHeader header;
+  const uint64_t file_size = layoutBinaryLibSvmModel(model, &header);
+  LibSvmBinaryModelWriter writer;
+  writer.buffer = NULL;
+  writer.size = 0;
+  writer.pos = 0;
+  writer.ok = true;
+#ifdef _WIN32
+  writer.fp = fopen(filename, "wb");
+  if (writer.fp == NULL) return false;
+  writeBinaryLibSvmModel(&writer, model, &header);
+  return fclose(writer.fp) == 0 && writer.ok && writer.pos == file_size;
+#else
+  static unsigned long n_saves = 0;
+  const size_t tmp_size = strlen(filename) + 64;
+  char* tmp_filename = ALLOC_N(char, tmp_size);
+  snprintf(tmp_filename, tmp_size, "%s.tmp.%ld.%lu", filename, (long)getpid(), n_saves++);
+  const int fd = open(tmp_filename, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  writer.fp = fd < 0 ? NULL : fdopen(fd, "wb");
+  if (writer.fp == NULL) {
+    if (fd >= 0) {
+      close(fd);
+      unlink(tmp_filename);
+    }
+    xfree(tmp_filename);
+    return false;
+  }
+  writeBinaryLibSvmModel(&writer, model, &header);
+  bool is_saved = fflush(writer.fp) == 0 && writer.ok && writer.pos == file_size;
+  is_saved = fsync(fileno(writer.fp)) == 0 && is_saved;
+  is_saved = fclose(writer.fp) == 0 && is_saved;
+  is_saved = is_saved && rename(tmp_filename, filename) == 0;
+  if (!is_saved) unlink(tmp_filename);
+  xfree(tmp_filename);
+  return is_saved;
+#endif
+}
+
+/**
+ * Dump the model to a binary String with the format of the binary model file, which is loaded with
+ * loadBinaryLibSvmModelString.
+ */
+VALUE dumpBinaryLibSvmModel(const LibSvmModel* const model) {
+  LibSvmBinaryModelHeader header;
+  const uint64_t size = layoutBinaryLibSvmModel(model, &header);
+  VALUE str = rb_str_new(NULL, (long)size);
+  LibSvmBinaryModelWriter writer;
+  writer.fp = NULL;
+  writer.buffer = RSTRING_PTR(str);
+  writer.size = size;
+  writer.pos = 0;
+  writer.ok = true;
+  writeBinaryLibSvmModel(&writer, model, &header);
+  if (!writer.ok || writer.pos != size) rb_raise(rb_eRuntimeError, "Failed to dump the model.");
+  return str;
+}
+
+/**
+ * Check the header, sections, and support vectors of the binary model file, and return the error message or NULL.
+ * The indices of the nodes in each row must be positive and strictly increasing up to the terminator, except that
+ * the first index of the precomputed kernel model is 0, so that the prediction buffers sized by the largest index
+ * are not inflated by a broken file.
+ */
+const char* checkBinaryLibSvmModel(const char* const ptr, const uint64_t size) {
+  if (size < sizeof(LibSvmBinaryModelHeader) || memcmp(ptr, BINARY_MODEL_MAGIC, sizeof(BINARY_MODEL_MAGIC)) != 0) {
+    return "not a binary model file";
+  }
+  const LibSvmBinaryModelHeader* const header = (const LibSvmBinaryModelHeader*)ptr;
+  if (header->version != BINARY_MODEL_VERSION) return "unsupported format version";
+  if (header->byte_order != BINARY_MODEL_BYTE_ORDER || header->node_size != sizeof(LibSvmNode)) {
+    return "byte order or node layout differs from this platform";
   }
-  if (NA_SHAPE(x_nary)[0] != NA_SHAPE(y_nary)[0]) {
-    rb_raise(rb_eArgError, "Expect to have the same number of samples for samples and labels.");
-    return Qnil;
+  if (header->svm_type < C_SVC || header->svm_type > NU_SVR || header->kernel_type < LINEAR ||
+      header->kernel_type > PRECOMPUTED) {
+    return "invalid svm_type or kernel_type";
   }
+  if (header->nr_class < 1 || header->l < 0) return "invalid number of classes or support vectors";
 
-  VALUE random_seed = rb_hash_aref(param_hash, ID2SYM(rb_intern("random_seed")));
-  if (!NIL_P(random_seed)) srand(NUM2UINT(random_seed));
+  const uint64_t* const offsets = header->offsets;
+  if (offsets[BINARY_RHO] == 0 || offsets[BINARY_SV_COEF] == 0 || offsets[BINARY_SV_OFFSETS] == 0 ||
+      offsets[BINARY_SV_NODES] == 0) {
+    return "rho, sv_coef, and support vectors are required";
+  }
+  const bool is_classifier = header->svm_type == C_SVC || header->svm_type == NU_SVC;
+  if (is_classifier && (offsets[BINARY_LABEL] == 0 || offsets[BINARY_N_SV] == 0)) return "label and nSV are required";
+
+  const uint64_t n_classes = header->nr_class;
+  const uint64_t n_support_vecs = header->l;
+  const uint64_t n_pairs = n_classes * (n_classes - 1) / 2;
+  const uint64_t counts[N_BINARY_SECTIONS] = {n_pairs,
+                                              n_pairs,
+                                              n_pairs,
+                                              NR_MARKS,
+                                              n_classes,
+                                              n_classes,
+                                              n_support_vecs,
+                                              (n_classes - 1) * n_support_vecs,
+                                              n_support_vecs + 1,
+                                              header->n_nodes};
+  const uint64_t elem_sizes[N_BINARY_SECTIONS] = {sizeof(double),  sizeof(double),  sizeof(double),  sizeof(double),
+                                                  sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(double),
+                                                  sizeof(uint64_t), sizeof(LibSvmNode)};
+  for (int s = 0; s < N_BINARY_SECTIONS; s++) {
+    const uint64_t offset = offsets[s];
+    if (offset == 0) continue;
+    if (offset % BINARY_MODEL_ALIGNMENT != 0 || offset < sizeof(LibSvmBinaryModelHeader) || offset > size ||
+        counts[s] > (size - offset) / elem_sizes[s]) {
+      return "sections are truncated or broken";
+    }
+  }
 
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmProblem* problem = convertDatasetToLibSvmProblem(x_val, y_val);
+  if (offsets[BINARY_N_SV]) {
+    const int32_t* const n_svs = (const int32_t*)(ptr + offsets[BINARY_N_SV]);
+    int64_t n_total_svs = 0;
+    for (uint64_t i = 0; i < n_classes; i++) {
+      if (n_svs[i] < 0) return "nSV is broken";
+      n_total_svs += n_svs[i];
+    }
+    if (is_classifier && n_total_svs != header->l) return "nSV is broken";
+  }
+  const uint64_t* const rows = (const uint64_t*)(ptr + offsets[BINARY_SV_OFFSETS]);
+  const LibSvmNode* const nodes = (const LibSvmNode*)(ptr + offsets[BINARY_SV_NODES]);
+  if (rows[0] != 0 || rows[n_support_vecs] != header->n_nodes) return "support vectors are broken";
+  for (uint64_t i = 0; i < n_support_vecs; i++) {
+    if (rows[i + 1] <= rows[i] || rows[i + 1] > header->n_nodes || nodes[rows[i + 1] - 1].index != -1) {
+      return "support vectors are broken";
+    }
+    int prev_index = header->kernel_type == PRECOMPUTED ? -1 : 0;
+    for (uint64_t k = rows[i]; k < rows[i + 1] - 1; k++) {
+      if (nodes[k].index <= prev_index) return "indices of support vectors are not positive and increasing";
+      prev_index = nodes[k].index;
+    }
+  }
+  return NULL;
+}
 
-  const char* err_msg = svm_check_parameter(problem, param);
+template <typename T> T* copyBinaryModelSection(const char* const ptr, const uint64_t offset, const size_t n) {
+  if (offset == 0) return NULL;
+  T* arr = ALLOC_N(T, n);
+  memcpy(arr, ptr + offset, n * sizeof(T));
+  return arr;
+}
+
+/**
+ * Convert the binary model checked with checkBinaryLibSvmModel to the model. The support vectors of the model point
+ * to the nodes in the binary model without parsing, and the other arrays are copied.
+ */
+LibSvmModel* convertBinaryToLibSvmModel(const char* const ptr) {
+  const LibSvmBinaryModelHeader* const header = (const LibSvmBinaryModelHeader*)ptr;
+  const uint64_t* const offsets = header->offsets;
+  const int n_classes = header->nr_class;
+  const int n_support_vecs = header->l;
+  const int n_pairs = n_classes * (n_classes - 1) / 2;
+  LibSvmModel* model = ALLOC(LibSvmModel);
+  memset(&model->param, 0, sizeof(LibSvmParameter));
+  model->param.svm_type = header->svm_type;
+  model->param.kernel_type = header->kernel_type;
+  model->param.degree = header->degree;
+  model->param.gamma = header->gamma;
+  model->param.coef0 = header->coef0;
+  model->param.cache_size = header->cache_size;
+  model->param.eps = header->eps;
+  model->param.C = header->C;
+  model->param.nu = header->nu;
+  model->param.p = header->p;
+  model->param.shrinking = header->shrinking;
+  model->param.probability = header->probability;
+  model->nr_class = n_classes;
+  model->l = n_support_vecs;
+  model->rho = copyBinaryModelSection<double>(ptr, offsets[BINARY_RHO], n_pairs);
+  model->probA = copyBinaryModelSection<double>(ptr, offsets[BINARY_PROB_A], n_pairs);
+  model->probB = copyBinaryModelSection<double>(ptr, offsets[BINARY_PROB_B], n_pairs);
+  model->prob_density_marks = copyBinaryModelSection<double>(ptr, offsets[BINARY_PROB_DENSITY_MARKS], NR_MARKS);
+  model->label = copyBinaryModelSection<int>(ptr, offsets[BINARY_LABEL], n_classes);
+  model->nSV = copyBinaryModelSection<int>(ptr, offsets[BINARY_N_SV], n_classes);
+  model->sv_indices = copyBinaryModelSection<int>(ptr, offsets[BINARY_SV_INDICES], n_support_vecs);
+  model->sv_coef = ALLOC_N(double*, n_classes - 1);
+  for (int i = 0; i < n_classes - 1; i++) {
+    const uint64_t offset = offsets[BINARY_SV_COEF] + (uint64_t)i * n_support_vecs * sizeof(double);
+    model->sv_coef[i] = copyBinaryModelSection<double>(ptr, offset, n_support_vecs);
+  }
+  const uint64_t* const rows = (const uint64_t*)(ptr + offsets[BINARY_SV_OFFSETS]);
+  // The nodes may be in the read-only mapping of the file, and the const is cast away only because svm_model holds
+  // mutable pointers. Nothing writes through them: the prediction only reads the support vectors, the conversion
+  // to a Hash copies them, and saveBinaryLibSvmModel replaces the file by renaming instead of rewriting it.
+  LibSvmNode* const nodes = (LibSvmNode*)(ptr + offsets[BINARY_SV_NODES]);
+  model->SV = ALLOC_N(LibSvmNode*, n_support_vecs);
+  for (int i = 0; i < n_support_vecs; i++) model->SV[i] = &nodes[rows[i]];
+  model->free_sv = 1;
+
+  return model;
+}
+
+/**
+ * Load the model from the binary model file saved with saveBinaryLibSvmModel. The support vectors of the model point
+ * to the nodes in the file mapped into memory. The object holding the mapped file is given as sv_source,
+ * which must be kept alive while the model is used.
+ */
+LibSvmModel* loadBinaryLibSvmModel(const char* const filename, VALUE* sv_source) {
+  VALUE file_val = mapModelFile(filename);
+  if (NIL_P(file_val)) {
+    rb_raise(rb_eIOError, "Failed to load file '%s'", filename);
+    return NULL;
+  }
+  const LibSvmModelMemory* const file = (const LibSvmModelMemory*)RTYPEDDATA_DATA(file_val);
+  const char* const err_msg = checkBinaryLibSvmModel(file->ptr, file->size);
   if (err_msg) {
-    deleteLibSvmProblem(problem);
-    deleteLibSvmParameter(param);
-    rb_raise(rb_eArgError, "Invalid LIBSVM parameter is given: %s", err_msg);
-    return Qnil;
+    rb_raise(rb_eIOError, "Failed to load file '%s': %s", filename, err_msg);
+    return NULL;
   }
 
-  size_t t_shape[1] = {(size_t)(problem->l)};
-  VALUE t_val = rb_narray_new(numo_cDFloat, 1, t_shape);
-  double* t_pt = (double*)na_get_pointer_for_write(t_val);
+  LibSvmModel* model = convertBinaryToLibSvmModel(file->ptr);
+  *sv_source = file_val;
+  RB_GC_GUARD(file_val);
 
-  VALUE verbose = rb_hash_aref(param_hash, ID2SYM(rb_intern("verbose")));
-  if (!RTEST(verbose)) svm_set_print_string_function(printNull);
+  return model;
+}
 
-  const int n_folds = NUM2INT(nr_folds);
-  svm_cross_validation(problem, param, n_folds, t_pt);
+/**
+ * Load the model from the String dumped with dumpBinaryLibSvmModel. The String is copied to the aligned memory
+ * held by the object given as sv_source, and the support vectors of the model point to the nodes in it.
+ */
+LibSvmModel* loadBinaryLibSvmModelString(VALUE str, VALUE* sv_source) {
+  StringValue(str);
+  char* ptr;
+  VALUE memory_val = allocModelMemory(RSTRING_LEN(str), &ptr);
+  memcpy(ptr, RSTRING_PTR(str), RSTRING_LEN(str));
+  const char* const err_msg = checkBinaryLibSvmModel(ptr, RSTRING_LEN(str));
+  if (err_msg) {
+    releaseModelMemory(memory_val);
+    rb_raise(rb_eArgError, "Failed to load the model: %s", err_msg);
+    return NULL;
+  }
 
-  deleteLibSvmProblem(problem);
-  deleteLibSvmParameter(param);
+  LibSvmModel* model = convertBinaryToLibSvmModel(ptr);
+  *sv_source = memory_val;
+  RB_GC_GUARD(memory_val);
+  RB_GC_GUARD(str);
 
-  RB_GC_GUARD(x_val);
-  RB_GC_GUARD(y_val);
+  return model;
+}
 
-  return t_val;
+/** MODULE FUNCTIONS */
+/**
+ * Get the initial model given by the keyword argument 'init_model'. If flag is not NULL, the boolean option given by
+ * the keyword argument flag_name (default: false) is also accepted.
+ */
+VALUE getInitModelFromKeywords(VALUE kw_args, const char* flag_name, bool* flag) {
+  if (flag) *flag = false;
+  if (NIL_P(kw_args)) return Qnil;
+  ID kw_table[2] = {rb_intern("init_model"), flag ? rb_intern(flag_name) : 0};
+  VALUE kw_values[2] = {Qundef, Qundef};
+  rb_get_kwargs(kw_args, kw_table, 0, flag ? 2 : 1, kw_values);
+  if (flag) *flag = kw_values[1] != Qundef && RTEST(kw_values[1]);
+  return kw_values[0] == Qundef ? Qnil : kw_values[0];
 }
 
-static VALUE numo_libsvm_predict(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+bool getSparseSvFromKeywords(VALUE kw_args) {
+  if (NIL_P(kw_args)) return false;
+  ID kw_table[1] = {rb_intern("sparse_sv")};
+  VALUE kw_values[1] = {Qundef};
+  rb_get_kwargs(kw_args, kw_table, 0, 1, kw_values);
+  return kw_values[0] != Qundef && RTEST(kw_values[0]);
+}
 
-  narray_t* x_nary;
-  GetNArray(x_val, x_nary);
-  if (NA_NDIM(x_nary) != 2) {
-    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
+VALUE checkInitModelHash(VALUE init_model_hash) {
+  if (!NIL_P(init_model_hash) && !RB_TYPE_P(init_model_hash, T_HASH)) {
+    rb_raise(rb_eArgError, "Expect initial model to be a Hash.");
     return Qnil;
   }
+  return init_model_hash;
+}
 
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
-  model->param = *param;
-
-  const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
-  size_t y_shape[1] = {(size_t)n_samples};
-  VALUE y_val = rb_narray_new(numo_cDFloat, 1, y_shape);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    y_ptr[i] = svm_predict(model, x_nodes);
-    xfree(x_nodes);
+/**
+ * Scan the positional arguments that begin with the samples and labels, or with the Dataset object without labels,
+ * followed by n_rest arguments. The samples and labels are prepared for training, and the Dataset object is given
+ * as x_val with nil labels.
+ */
+void scanTrainingArgs(const int argc, const VALUE* const argv, const int n_rest, VALUE* x_val, VALUE* y_val, VALUE* rest) {
+  const int n_heads = argc > 0 && isLibSvmDataset(argv[0]) ? 1 : 2;
+  rb_check_arity(argc, n_heads + n_rest, n_heads + n_rest);
+  for (int i = 0; i < n_rest; i++) rest[i] = argv[n_heads + i];
+  if (n_heads == 1) {
+    *x_val = argv[0];
+    *y_val = Qnil;
+  } else {
+    *x_val = prepareSamples(argv[0]);
+    *y_val = prepareLabels(argv[1], getNumSamples(*x_val));
   }
+}
 
+static VALUE numo_libsvm_train(int argc, VALUE* argv, VALUE self) {
+  VALUE args, kw_args, x_val, y_val, param_hash;
+  rb_scan_args(argc, argv, "*:", &args, &kw_args);
+  scanTrainingArgs((int)RARRAY_LEN(args), RARRAY_CONST_PTR(args), 1, &x_val, &y_val, &param_hash);
+  bool sparse_sv;
+  VALUE init_model_hash = checkInitModelHash(getInitModelFromKeywords(kw_args, "sparse_sv", &sparse_sv));
+  LibSvmModel* model = trainLibSvmModel(x_val, y_val, param_hash, init_model_hash, false);
+  VALUE model_hash = convertLibSvmModelToHash(model, sparse_sv);
   deleteLibSvmModel(model);
-  deleteLibSvmParameter(param);
+  RB_GC_GUARD(args);
+  return model_hash;
+}
 
+static VALUE numo_libsvm_train_csr(int argc, VALUE* argv, VALUE self) {
+  VALUE indptr, indices, data, y_val, param_hash, kw_args;
+  rb_scan_args(argc, argv, "5:", &indptr, &indices, &data, &y_val, &param_hash, &kw_args);
+  bool sparse_sv;
+  VALUE init_model_hash = checkInitModelHash(getInitModelFromKeywords(kw_args, "sparse_sv", &sparse_sv));
+  VALUE x_val = prepareCsrMatrix(indptr, indices, data);
+  y_val = prepareLabels(y_val, getNumSamples(x_val));
+  LibSvmModel* model = trainLibSvmModel(x_val, y_val, param_hash, init_model_hash, false);
+  VALUE model_hash = convertLibSvmModelToHash(model, sparse_sv);
+  deleteLibSvmModel(model);
   RB_GC_GUARD(x_val);
+  return model_hash;
+}
 
-  return y_val;
+static VALUE numo_libsvm_cross_validation(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, y_val, rest[2];
+  scanTrainingArgs(argc, argv, 2, &x_val, &y_val, rest);
+  return crossValidateLibSvmModel(x_val, y_val, rest[0], NUM2INT(rest[1]));
+}
+
+static VALUE numo_libsvm_cross_validation_csr(VALUE self, VALUE indptr, VALUE indices, VALUE data, VALUE y_val,
+                                              VALUE param_hash, VALUE nr_folds) {
+  VALUE x_val = prepareCsrMatrix(indptr, indices, data);
+  y_val = prepareLabels(y_val, getNumSamples(x_val));
+  VALUE t_val = crossValidateLibSvmModel(x_val, y_val, param_hash, NUM2INT(nr_folds));
+  RB_GC_GUARD(x_val);
+  return t_val;
+}
+
+static VALUE numo_libsvm_grid_search(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, y_val, rest[3];
+  scanTrainingArgs(argc, argv, 3, &x_val, &y_val, rest);
+  return gridSearchLibSvmModel(x_val, y_val, rest[0], rest[1], NUM2INT(rest[2]));
+}
+
+static VALUE numo_libsvm_predict(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
+  return predictLibSvmModelHash(prepareSamples(x_val), param_hash, model_hash, PREDICT_LABEL);
 }
 
 static VALUE numo_libsvm_decision_function(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+  return predictLibSvmModelHash(prepareSamples(x_val), param_hash, model_hash, PREDICT_DECISION_VALUES);
+}
 
-  narray_t* x_nary;
-  GetNArray(x_val, x_nary);
-  if (NA_NDIM(x_nary) != 2) {
-    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
+static VALUE numo_libsvm_predict_proba(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
+  return predictLibSvmModelHash(prepareSamples(x_val), param_hash, model_hash, PREDICT_PROBABILITY);
+}
+
+static VALUE numo_libsvm_predict_csr(VALUE self, VALUE indptr, VALUE indices, VALUE data, VALUE param_hash, VALUE model_hash) {
+  return predictLibSvmModelHash(prepareCsrMatrix(indptr, indices, data), param_hash, model_hash, PREDICT_LABEL);
+}
+
+static VALUE numo_libsvm_decision_function_csr(VALUE self, VALUE indptr, VALUE indices, VALUE data, VALUE param_hash,
+                                               VALUE model_hash) {
+  return predictLibSvmModelHash(prepareCsrMatrix(indptr, indices, data), param_hash, model_hash, PREDICT_DECISION_VALUES);
+}
+
+static VALUE numo_libsvm_predict_proba_csr(VALUE self, VALUE indptr, VALUE indices, VALUE data, VALUE param_hash,
+                                           VALUE model_hash) {
+  return predictLibSvmModelHash(prepareCsrMatrix(indptr, indices, data), param_hash, model_hash, PREDICT_PROBABILITY);
+}
+
+int getNumJobsFromKeywords(VALUE kw_args) {
+  if (NIL_P(kw_args)) return 1;
+  ID kw_table[1] = {rb_intern("n_jobs")};
+  VALUE kw_values[1] = {Qundef};
+  rb_get_kwargs(kw_args, kw_table, 0, 1, kw_values);
+  return getNumJobs(kw_values[0] == Qundef ? Qnil : kw_values[0]);
+}
+
+static VALUE numo_libsvm_load_model(int argc, VALUE* argv, VALUE self) {
+  VALUE filename, kw_args;
+  rb_scan_args(argc, argv, "1:", &filename, &kw_args);
+  VALUE kw_values[2] = {Qundef, Qundef};
+  if (!NIL_P(kw_args)) {
+    ID kw_table[2] = {rb_intern("sparse_sv"), rb_intern("n_jobs")};
+    rb_get_kwargs(kw_args, kw_table, 0, 2, kw_values);
+  }
+  const bool sparse_sv = kw_values[0] != Qundef && RTEST(kw_values[0]);
+  const int n_jobs = getNumJobs(kw_values[1] == Qundef ? Qnil : kw_values[1]);
+  const char* const filename_ = StringValuePtr(filename);
+  VALUE sv_source = Qnil;
+  LibSvmModel* model = loadLibSvmModelText(filename_, n_jobs, &sv_source);
+  if (model == NULL) {
+    rb_raise(rb_eIOError, "Failed to load file '%s'", filename_);
     return Qnil;
   }
 
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
-  model->param = *param;
+  VALUE param_hash = convertLibSvmParameterToHash(&(model->param));
+  VALUE model_hash = convertLibSvmModelToHash(model, sparse_sv);
+  LibSvmModelData data;
+  initLibSvmModelData(&data, model);
+  data.sv_source = sv_source;
+  deleteLibSvmModelOfData(&data);
+  releaseModelMemory(sv_source);
 
-  const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
-  const int y_cols = isSignleOutputModel(model) ? 1 : model->nr_class * (model->nr_class - 1) / 2;
-  size_t y_shape[2] = {(size_t)n_samples, (size_t)y_cols};
-  const int n_dims = isSignleOutputModel(model) ? 1 : 2;
-  VALUE y_val = rb_narray_new(numo_cDFloat, n_dims, y_shape);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
+  VALUE res = rb_ary_new2(2);
+  rb_ary_store(res, 0, param_hash);
+  rb_ary_store(res, 1, model_hash);
 
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    svm_predict_values(model, x_nodes, &y_ptr[i * y_cols]);
-    xfree(x_nodes);
-  }
+  RB_GC_GUARD(filename);
+
+  return res;
+}
+
+static VALUE numo_libsvm_save_model(int argc, VALUE* argv, VALUE self) {
+  VALUE filename, param_hash, model_hash, kw_args;
+  rb_scan_args(argc, argv, "3:", &filename, &param_hash, &model_hash, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
+  const char* const filename_ = StringValuePtr(filename);
+  LibSvmModel* model = convertHashesToLibSvmModel(param_hash, model_hash);
+
+  const bool res = saveLibSvmModelText(filename_, model, n_jobs);
 
   deleteLibSvmModel(model);
-  deleteLibSvmParameter(param);
 
-  RB_GC_GUARD(x_val);
+  if (!res) {
+    rb_raise(rb_eIOError, "Failed to save file '%s'", filename_);
+    return Qfalse;
+  }
 
-  return y_val;
+  RB_GC_GUARD(filename);
+
+  return Qtrue;
 }
 
-static VALUE numo_libsvm_predict_proba(VALUE self, VALUE x_val, VALUE param_hash, VALUE model_hash) {
-  narray_t* x_nary;
-  GetNArray(x_val, x_nary);
-  if (NA_NDIM(x_nary) != 2) {
-    rb_raise(rb_eArgError, "Expect samples to be 2-D array.");
-    return Qnil;
+/** MODEL CLASS */
+static void numo_libsvm_model_mark(void* ptr) { rb_gc_mark(((LibSvmModelData*)ptr)->sv_source); }
+
+static void numo_libsvm_model_free(void* ptr) {
+  LibSvmModelData* data = (LibSvmModelData*)ptr;
+  deletePredictionCache(data);
+  deleteLibSvmModelOfData(data);
+  xfree(data);
+}
+
+static size_t numo_libsvm_model_size(const void* ptr) {
+  const LibSvmModelData* const data = (const LibSvmModelData*)ptr;
+  const LibSvmModel* const model = data->model;
+  size_t size = sizeof(LibSvmModelData);
+  if (model == NULL) return size;
+  const int n_classes = model->nr_class;
+  size += sizeof(LibSvmModel);
+  if (model->SV) {
+    size += model->l * sizeof(LibSvmNode*);
+    for (int i = 0; NIL_P(data->sv_source) && i < model->l; i++) {
+      int n_nodes = 0;
+      while (model->SV[i][n_nodes].index != -1) n_nodes++;
+      size += (n_nodes + 1) * sizeof(LibSvmNode);
+    }
   }
+  if (model->sv_coef) size += (n_classes - 1) * (sizeof(double*) + model->l * sizeof(double));
+  if (model->rho) size += n_classes * (n_classes - 1) / 2 * sizeof(double);
+  if (model->probA) size += n_classes * (n_classes - 1) / 2 * sizeof(double);
+  if (model->probB) size += n_classes * (n_classes - 1) / 2 * sizeof(double);
+  if (model->prob_density_marks) size += NR_MARKS * sizeof(double);
+  if (model->sv_indices) size += model->l * sizeof(int);
+  if (model->label) size += n_classes * sizeof(int);
+  if (model->nSV) size += n_classes * sizeof(int);
+  if (data->sv_dense) size += (size_t)model->l * data->n_sv_features * sizeof(double);
+  if (data->sv_sq_norms) size += model->l * sizeof(double);
+  return size;
+}
 
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
-  model->param = *param;
+static const rb_data_type_t numo_libsvm_model_type = {"Numo::Libsvm::Model",
+                                                       {numo_libsvm_model_mark, numo_libsvm_model_free, numo_libsvm_model_size},
+                                                       NULL,
+                                                       NULL,
+                                                       RUBY_TYPED_FREE_IMMEDIATELY};
+
+static VALUE numo_libsvm_model_alloc(VALUE klass) {
+  LibSvmModelData* data = ALLOC(LibSvmModelData);
+  initLibSvmModelData(data, NULL);
+  return TypedData_Wrap_Struct(klass, &numo_libsvm_model_type, data);
+}
+
+LibSvmModelData* getLibSvmModelData(VALUE self) {
+  LibSvmModelData* data;
+  TypedData_Get_Struct(self, LibSvmModelData, &numo_libsvm_model_type, data);
+  if (data->model == NULL) rb_raise(rb_eRuntimeError, "Uninitialized model is given.");
+  return data;
+}
 
-  if (!isProbabilisticModel(model)) {
+/**
+ * Set the model to the Model object. If the support vectors of the model point to the nodes held by another object,
+ * such as the Dataset object or mapped model file, it is given as sv_source and kept alive with the Model object,
+ * otherwise sv_source is nil.
+ */
+void setLibSvmModel(VALUE self, LibSvmModel* model, VALUE sv_source) {
+  LibSvmModelData* data;
+  TypedData_Get_Struct(self, LibSvmModelData, &numo_libsvm_model_type, data);
+  // The model may be used by the prediction running without the GVL in other threads, so it is not reinitialized.
+  if (data->model != NULL) {
+    if (!NIL_P(sv_source)) {
+      xfree(model->SV);
+      model->SV = NULL;
+    }
     deleteLibSvmModel(model);
-    deleteLibSvmParameter(param);
-    return Qnil;
+    rb_raise(rb_eRuntimeError, "Model is already initialized.");
   }
+  initLibSvmModelData(data, model);
+  data->sv_source = sv_source;
+  buildPredictionCache(data);
+}
 
-  if (CLASS_OF(x_val) != numo_cDFloat) x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  if (!RTEST(nary_check_contiguous(x_val))) x_val = nary_dup(x_val);
+static VALUE numo_libsvm_model_init(VALUE self, VALUE param_hash, VALUE model_hash) {
+  LibSvmModel* model = convertHashesToLibSvmModel(param_hash, model_hash);
+  setLibSvmModel(self, model, Qnil);
 
-  const int n_samples = (int)NA_SHAPE(x_nary)[0];
-  const int n_features = (int)NA_SHAPE(x_nary)[1];
-  size_t y_shape[2] = {(size_t)n_samples, (size_t)(model->nr_class)};
-  VALUE y_val = rb_narray_new(numo_cDFloat, 2, y_shape);
-  const double* const x_ptr = (double*)na_get_pointer_for_read(x_val);
-  double* y_ptr = (double*)na_get_pointer_for_write(y_val);
-  for (int i = 0; i < n_samples; i++) {
-    LibSvmNode* x_nodes = convertVectorXdToLibSvmNode(&x_ptr[i * n_features], n_features);
-    svm_predict_probability(model, x_nodes, &y_ptr[i * model->nr_class]);
-    xfree(x_nodes);
+  return self;
+}
+
+static VALUE numo_libsvm_model_init_copy(VALUE self, VALUE other) {
+  if (self == other) return self;
+  const LibSvmModelData* const src = getLibSvmModelData(other);
+  setLibSvmModel(self, copyLibSvmModel(src->model, !NIL_P(src->sv_source)), src->sv_source);
+  return self;
+}
+
+/**
+ * Get the initial model for warm start given as a Model object or model hash by the keyword argument 'init_model'.
+ * If share_sv is not NULL, the keyword argument 'share_sv' is also accepted.
+ */
+VALUE getInitModelHashFromKeywords(VALUE kw_args, bool* share_sv) {
+  VALUE init_model = getInitModelFromKeywords(kw_args, "share_sv", share_sv);
+  if (rb_typeddata_is_kind_of(init_model, &numo_libsvm_model_type)) {
+    return convertLibSvmModelToHash(getLibSvmModelData(init_model)->model, true);
   }
+  return checkInitModelHash(init_model);
+}
 
-  deleteLibSvmModel(model);
-  deleteLibSvmParameter(param);
+static VALUE numo_libsvm_model_s_train(int argc, VALUE* argv, VALUE klass) {
+  VALUE args, kw_args, x_val, y_val, param_hash;
+  rb_scan_args(argc, argv, "*:", &args, &kw_args);
+  scanTrainingArgs((int)RARRAY_LEN(args), RARRAY_CONST_PTR(args), 1, &x_val, &y_val, &param_hash);
+  bool share_sv;
+  VALUE init_model_hash = getInitModelHashFromKeywords(kw_args, &share_sv);
+  // The samples given as NArray are released after training, so only the nodes of the Dataset object are shared.
+  share_sv = share_sv && isLibSvmDataset(x_val);
+  LibSvmModel* model = trainLibSvmModel(x_val, y_val, param_hash, init_model_hash, share_sv);
+  VALUE self = numo_libsvm_model_alloc(klass);
+  setLibSvmModel(self, model, share_sv ? x_val : Qnil);
+  RB_GC_GUARD(args);
+  return self;
+}
 
+static VALUE numo_libsvm_model_s_train_csr(int argc, VALUE* argv, VALUE klass) {
+  VALUE indptr, indices, data, y_val, param_hash, kw_args;
+  rb_scan_args(argc, argv, "5:", &indptr, &indices, &data, &y_val, &param_hash, &kw_args);
+  VALUE init_model_hash = getInitModelHashFromKeywords(kw_args, NULL);
+  VALUE x_val = prepareCsrMatrix(indptr, indices, data);
+  y_val = prepareLabels(y_val, getNumSamples(x_val));
+  LibSvmModel* model = trainLibSvmModel(x_val, y_val, param_hash, init_model_hash, false);
+  VALUE self = numo_libsvm_model_alloc(klass);
+  setLibSvmModel(self, model, Qnil);
   RB_GC_GUARD(x_val);
-
-  return y_val;
+  return self;
 }
 
-static VALUE numo_libsvm_load_model(VALUE self, VALUE filename) {
+static VALUE numo_libsvm_model_s_load_svm_model(int argc, VALUE* argv, VALUE klass) {
+  VALUE filename, kw_args;
+  rb_scan_args(argc, argv, "1:", &filename, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
   const char* const filename_ = StringValuePtr(filename);
-  LibSvmModel* model = svm_load_model(filename_);
+  VALUE sv_source = Qnil;
+  LibSvmModel* model = loadLibSvmModelText(filename_, n_jobs, &sv_source);
   if (model == NULL) {
     rb_raise(rb_eIOError, "Failed to load file '%s'", filename_);
     return Qnil;
   }
 
-  VALUE param_hash = convertLibSvmParameterToHash(&(model->param));
-  VALUE model_hash = convertLibSvmModelToHash(model);
-  svm_free_and_destroy_model(&model);
+  VALUE self = numo_libsvm_model_alloc(klass);
+  setLibSvmModel(self, model, sv_source);
 
-  VALUE res = rb_ary_new2(2);
-  rb_ary_store(res, 0, param_hash);
-  rb_ary_store(res, 1, model_hash);
+  RB_GC_GUARD(sv_source);
+  RB_GC_GUARD(filename);
+
+  return self;
+}
+
+static VALUE numo_libsvm_model_s_load(VALUE klass, VALUE str) {
+  VALUE sv_source = Qnil;
+  LibSvmModel* model = loadBinaryLibSvmModelString(str, &sv_source);
+  VALUE self = numo_libsvm_model_alloc(klass);
+  setLibSvmModel(self, model, sv_source);
+
+  RB_GC_GUARD(sv_source);
+
+  return self;
+}
 
+static VALUE numo_libsvm_model_s_load_binary_model(VALUE klass, VALUE filename) {
+  VALUE sv_source = Qnil;
+  LibSvmModel* model = loadBinaryLibSvmModel(StringValuePtr(filename), &sv_source);
+  VALUE self = numo_libsvm_model_alloc(klass);
+  setLibSvmModel(self, model, sv_source);
+
+  RB_GC_GUARD(sv_source);
   RB_GC_GUARD(filename);
 
-  return res;
+  return self;
 }
 
-static VALUE numo_libsvm_save_model(VALUE self, VALUE filename, VALUE param_hash, VALUE model_hash) {
-  LibSvmParameter* param = convertHashToLibSvmParameter(param_hash);
-  LibSvmModel* model = convertHashToLibSvmModel(model_hash);
-  model->param = *param;
+VALUE predictWithModelObject(int argc, VALUE* argv, VALUE self, const int type) {
+  VALUE x_val = Qnil;
+  VALUE kw_args = Qnil;
+  rb_scan_args(argc, argv, "1:", &x_val, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
+  LibSvmModelData* data = getLibSvmModelData(self);
+  x_val = prepareSamples(x_val);
+  VALUE y_val = predictLibSvmModel(x_val, data, type, n_jobs);
+  RB_GC_GUARD(x_val);
+  return y_val;
+}
+
+VALUE predictCsrWithModelObject(int argc, VALUE* argv, VALUE self, const int type) {
+  VALUE indptr = Qnil;
+  VALUE indices = Qnil;
+  VALUE data_val = Qnil;
+  VALUE kw_args = Qnil;
+  rb_scan_args(argc, argv, "3:", &indptr, &indices, &data_val, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
+  LibSvmModelData* data = getLibSvmModelData(self);
+  VALUE x_val = prepareCsrMatrix(indptr, indices, data_val);
+  VALUE y_val = predictLibSvmModel(x_val, data, type, n_jobs);
+  RB_GC_GUARD(x_val);
+  return y_val;
+}
+
+static VALUE numo_libsvm_model_predict(int argc, VALUE* argv, VALUE self) {
+  return predictWithModelObject(argc, argv, self, PREDICT_LABEL);
+}
+
+static VALUE numo_libsvm_model_decision_function(int argc, VALUE* argv, VALUE self) {
+  return predictWithModelObject(argc, argv, self, PREDICT_DECISION_VALUES);
+}
+
+static VALUE numo_libsvm_model_predict_proba(int argc, VALUE* argv, VALUE self) {
+  return predictWithModelObject(argc, argv, self, PREDICT_PROBABILITY);
+}
+
+static VALUE numo_libsvm_model_predict_csr(int argc, VALUE* argv, VALUE self) {
+  return predictCsrWithModelObject(argc, argv, self, PREDICT_LABEL);
+}
+
+static VALUE numo_libsvm_model_decision_function_csr(int argc, VALUE* argv, VALUE self) {
+  return predictCsrWithModelObject(argc, argv, self, PREDICT_DECISION_VALUES);
+}
+
+static VALUE numo_libsvm_model_predict_proba_csr(int argc, VALUE* argv, VALUE self) {
+  return predictCsrWithModelObject(argc, argv, self, PREDICT_PROBABILITY);
+}
 
+static VALUE numo_libsvm_model_save_svm_model(int argc, VALUE* argv, VALUE self) {
+  VALUE filename, kw_args;
+  rb_scan_args(argc, argv, "1:", &filename, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
+  LibSvmModel* model = getLibSvmModelData(self)->model;
   const char* const filename_ = StringValuePtr(filename);
-  const int res = svm_save_model(filename_, model);
+  if (!saveLibSvmModelText(filename_, model, n_jobs)) {
+    rb_raise(rb_eIOError, "Failed to save file '%s'", filename_);
+    return Qfalse;
+  }
 
-  deleteLibSvmModel(model);
-  deleteLibSvmParameter(param);
+  RB_GC_GUARD(filename);
+
+  return Qtrue;
+}
 
-  if (res < 0) {
+static VALUE numo_libsvm_model_save_binary_model(VALUE self, VALUE filename) {
+  LibSvmModel* model = getLibSvmModelData(self)->model;
+  const char* const filename_ = StringValuePtr(filename);
+  if (!saveBinaryLibSvmModel(filename_, model)) {
     rb_raise(rb_eIOError, "Failed to save file '%s'", filename_);
     return Qfalse;
   }
@@ -718,4 +3889,73 @@ static VALUE numo_libsvm_save_model(VALUE self, VALUE filename, VALUE param_hash
   return Qtrue;
 }
 
+static VALUE numo_libsvm_model_param(VALUE self) { return convertLibSvmParameterToHash(&(getLibSvmModelData(self)->model->param)); }
+
+static VALUE numo_libsvm_model_to_h(int argc, VALUE* argv, VALUE self) {
+  VALUE kw_args;
+  rb_scan_args(argc, argv, "0:", &kw_args);
+  return convertLibSvmModelToHash(getLibSvmModelData(self)->model, getSparseSvFromKeywords(kw_args));
+}
+
+static VALUE numo_libsvm_model_dump(VALUE self, VALUE level) { return dumpBinaryLibSvmModel(getLibSvmModelData(self)->model); }
+
+/** DATASET CLASS */
+static VALUE numo_libsvm_dataset_alloc(VALUE klass) { return TypedData_Wrap_Struct(klass, &numo_libsvm_dataset_type, NULL); }
+
+void setLibSvmProblem(VALUE self, LibSvmProblem* problem) {
+  // The nodes of the dataset may be shared with the support vectors of models, so the dataset is not reinitialized.
+  if (RTYPEDDATA_DATA(self) != NULL) {
+    deleteLibSvmProblem(problem);
+    rb_raise(rb_eRuntimeError, "Dataset is already initialized.");
+  }
+  RTYPEDDATA_DATA(self) = problem;
+}
+
+LibSvmProblem* copyLibSvmProblem(const LibSvmProblem* const src) {
+  size_t n_nodes = 0;
+  for (int i = 0; i < src->l; i++) {
+    int n_row_nodes = 1;
+    while (src->x[i][n_row_nodes - 1].index != -1) n_row_nodes++;
+    n_nodes += n_row_nodes;
+  }
+  LibSvmNode* node;
+  LibSvmProblem* problem = allocLibSvmProblem(src->l, n_nodes, &node);
+  memcpy(problem->y, src->y, src->l * sizeof(double));
+  for (int i = 0; i < src->l; i++) {
+    int n_row_nodes = 1;
+    while (src->x[i][n_row_nodes - 1].index != -1) n_row_nodes++;
+    problem->x[i] = node;
+    memcpy(node, src->x[i], n_row_nodes * sizeof(LibSvmNode));
+    node += n_row_nodes;
+  }
+  return problem;
+}
+
+static VALUE numo_libsvm_dataset_init(int argc, VALUE* argv, VALUE self) {
+  VALUE x_val, y_val, kw_args;
+  rb_scan_args(argc, argv, "2:", &x_val, &y_val, &kw_args);
+  const int n_jobs = getNumJobsFromKeywords(kw_args);
+  x_val = prepareSamples(x_val);
+  y_val = prepareLabels(y_val, getNumSamples(x_val));
+  setLibSvmProblem(self, convertSamplesToLibSvmProblem(x_val, y_val, n_jobs));
+  return self;
+}
+
+static VALUE numo_libsvm_dataset_init_copy(VALUE self, VALUE other) {
+  if (self == other) return self;
+  setLibSvmProblem(self, copyLibSvmProblem(getLibSvmProblemOfDataset(other)));
+  return self;
+}
+
+static VALUE numo_libsvm_dataset_s_from_csr(VALUE klass, VALUE indptr, VALUE indices, VALUE data, VALUE y_val) {
+  VALUE x_val = prepareCsrMatrix(indptr, indices, data);
+  y_val = prepareLabels(y_val, getNumSamples(x_val));
+  VALUE self = numo_libsvm_dataset_alloc(klass);
+  setLibSvmProblem(self, convertSamplesToLibSvmProblem(x_val, y_val, 1));
+  RB_GC_GUARD(x_val);
+  return self;
+}
+
+static VALUE numo_libsvm_dataset_n_samples(VALUE self) { return INT2NUM(getLibSvmProblemOfDataset(self)->l); }
+
 #endif /* LIBSVMEXT_HPP */
@@ -7,10 +7,18 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <locale.h>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include "svm.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SVM_DENSE_X86 1
+#include <immintrin.h>
+#endif
 
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
@@ -62,6 +70,85 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+//
+// Parallel execution
+//
+// run_parallel calls func(task) for the tasks in [0,n_task) on nr_thread threads including the calling thread.
+// The tasks are started in increasing order. If no more threads can be created, the remaining tasks are run
+// on the threads already started.
+//
+template <class Func> static void run_parallel(int nr_thread, int n_task, Func func)
+{
+	std::atomic<int> next_task(0);
+	auto worker = [&]()
+	{
+		for(int task = next_task++; task < n_task; task = next_task++)
+			func(task);
+	};
+	std::vector<std::thread> threads;
+	for(int t=1;t<nr_thread && t<n_task;t++)
+	{
+		try
+		{
+			threads.push_back(std::thread(worker));
+		}
+		catch(const std::system_error&)
+		{
+			break;
+		}
+	}
+	worker();
+	for(size_t t=0;t<threads.size();t++)
+		threads[t].join();
+}
+
+//
+// A random number generator with an explicit state instead of the process-wide state of rand(), so that
+// the concurrent calls of training do not disturb each other. It is the additive feedback generator of random()
+// in the GNU C library, and gives the same sequence as rand() after srand(seed) there.
+// The subproblems trained concurrently draw the random numbers from the copies of the generator taken in the order
+// of the serial training, so that the results are the same as those of the serial training with any number of threads.
+//
+static inline int rand_next(svm_rand *rng)
+{
+	unsigned int val = (unsigned int)rng->state[rng->front] + (unsigned int)rng->state[rng->rear];
+	rng->state[rng->front] = (int)val;
+	if(++rng->front == 31) rng->front = 0;
+	if(++rng->rear == 31) rng->rear = 0;
+	return (int)(val >> 1);
+}
+
+void svm_srand(svm_rand *rng, unsigned int seed)
+{
+	if(seed == 0) seed = 1;
+	rng->state[0] = (int)seed;
+	int word = (int)seed;
+	for(int i=1;i<31;i++)
+	{
+		// state[i] = (16807 * state[i-1]) % 2147483647 without overflow
+		int hi = word/127773;
+		int lo = word%127773;
+		word = 16807*lo-2836*hi;
+		if(word < 0) word += 2147483647;
+		rng->state[i] = word;
+	}
+	rng->front = 3;
+	rng->rear = 0;
+	for(int i=0;i<310;i++) rand_next(rng);
+}
+
+// draw a random integer in [0,n)
+static inline int rand_int(svm_rand *rng, int n)
+{
+	return rand_next(rng)%n;
+}
+
+// advance the generator as drawing n random numbers
+static void rand_skip(svm_rand *rng, long long n)
+{
+	for(long long i=0;i<n;i++) rand_next(rng);
+}
+
 //
 // Kernel Cache
 //
@@ -188,6 +275,230 @@ void Cache::swap_index(int i, int j)
 	}
 }
 
+//
+// Dense vector operations
+//
+// dense_dot and dense_sqdist are selected by CPU feature detection when the library is loaded
+// from the AVX-512, AVX2 and SSE2 implementations, or the portable one for the other platforms.
+// The implementations sum in different orders, so the kernel values and the trained models may
+// differ in the last bits between CPUs.
+//
+typedef double (*dense_func_t)(const double *x, const double *y, int n);
+
+static double dense_dot_generic(const double *x, const double *y, int n)
+{
+	double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+	int i = 0;
+	for(; i+4<=n; i+=4)
+	{
+		sum0 += x[i]*y[i];
+		sum1 += x[i+1]*y[i+1];
+		sum2 += x[i+2]*y[i+2];
+		sum3 += x[i+3]*y[i+3];
+	}
+	for(; i<n; i++)
+		sum0 += x[i]*y[i];
+	return (sum0+sum1)+(sum2+sum3);
+}
+
+static double dense_sqdist_generic(const double *x, const double *y, int n)
+{
+	double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+	int i = 0;
+	for(; i+4<=n; i+=4)
+	{
+		double d0 = x[i]-y[i], d1 = x[i+1]-y[i+1], d2 = x[i+2]-y[i+2], d3 = x[i+3]-y[i+3];
+		sum0 += d0*d0;
+		sum1 += d1*d1;
+		sum2 += d2*d2;
+		sum3 += d3*d3;
+	}
+	for(; i<n; i++)
+		sum0 += (x[i]-y[i])*(x[i]-y[i]);
+	return (sum0+sum1)+(sum2+sum3);
+}
+
+#ifdef SVM_DENSE_X86
+__attribute__((target("sse2")))
+static double dense_dot_sse2(const double *x, const double *y, int n)
+{
+	__m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+	int i = 0;
+	for(; i+4<=n; i+=4)
+	{
+		sum0 = _mm_add_pd(sum0,_mm_mul_pd(_mm_loadu_pd(x+i),_mm_loadu_pd(y+i)));
+		sum1 = _mm_add_pd(sum1,_mm_mul_pd(_mm_loadu_pd(x+i+2),_mm_loadu_pd(y+i+2)));
+	}
+	sum0 = _mm_add_pd(sum0,sum1);
+	double sum = _mm_cvtsd_f64(_mm_add_sd(sum0,_mm_unpackhi_pd(sum0,sum0)));
+	for(; i<n; i++)
+		sum += x[i]*y[i];
+	return sum;
+}
+
+__attribute__((target("sse2")))
+static double dense_sqdist_sse2(const double *x, const double *y, int n)
+{
+	__m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+	int i = 0;
+	for(; i+4<=n; i+=4)
+	{
+		__m128d d0 = _mm_sub_pd(_mm_loadu_pd(x+i),_mm_loadu_pd(y+i));
+		__m128d d1 = _mm_sub_pd(_mm_loadu_pd(x+i+2),_mm_loadu_pd(y+i+2));
+		sum0 = _mm_add_pd(sum0,_mm_mul_pd(d0,d0));
+		sum1 = _mm_add_pd(sum1,_mm_mul_pd(d1,d1));
+	}
+	sum0 = _mm_add_pd(sum0,sum1);
+	double sum = _mm_cvtsd_f64(_mm_add_sd(sum0,_mm_unpackhi_pd(sum0,sum0)));
+	for(; i<n; i++)
+		sum += (x[i]-y[i])*(x[i]-y[i]);
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static double dense_hsum_avx2(__m256d v)
+{
+	__m128d h = _mm_add_pd(_mm256_castpd256_pd128(v),_mm256_extractf128_pd(v,1));
+	return _mm_cvtsd_f64(_mm_add_sd(h,_mm_unpackhi_pd(h,h)));
+}
+
+__attribute__((target("avx2,fma")))
+static double dense_dot_avx2(const double *x, const double *y, int n)
+{
+	__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for(; i+8<=n; i+=8)
+	{
+		sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i),_mm256_loadu_pd(y+i),sum0);
+		sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i+4),_mm256_loadu_pd(y+i+4),sum1);
+	}
+	if(i+4<=n)
+	{
+		sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+i),_mm256_loadu_pd(y+i),sum0);
+		i += 4;
+	}
+	double sum = dense_hsum_avx2(_mm256_add_pd(sum0,sum1));
+	for(; i<n; i++)
+		sum += x[i]*y[i];
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static double dense_sqdist_avx2(const double *x, const double *y, int n)
+{
+	__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for(; i+8<=n; i+=8)
+	{
+		__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(x+i),_mm256_loadu_pd(y+i));
+		__m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(x+i+4),_mm256_loadu_pd(y+i+4));
+		sum0 = _mm256_fmadd_pd(d0,d0,sum0);
+		sum1 = _mm256_fmadd_pd(d1,d1,sum1);
+	}
+	if(i+4<=n)
+	{
+		__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(x+i),_mm256_loadu_pd(y+i));
+		sum0 = _mm256_fmadd_pd(d0,d0,sum0);
+		i += 4;
+	}
+	double sum = dense_hsum_avx2(_mm256_add_pd(sum0,sum1));
+	for(; i<n; i++)
+		sum += (x[i]-y[i])*(x[i]-y[i]);
+	return sum;
+}
+
+__attribute__((target("avx512f")))
+static double dense_hsum_avx512(__m512d v)
+{
+	double buf[8];
+	_mm512_storeu_pd(buf,v);
+	return ((buf[0]+buf[1])+(buf[2]+buf[3]))+((buf[4]+buf[5])+(buf[6]+buf[7]));
+}
+
+__attribute__((target("avx512f")))
+static double dense_dot_avx512(const double *x, const double *y, int n)
+{
+	__m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+	int i = 0;
+	for(; i+16<=n; i+=16)
+	{
+		sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i),_mm512_loadu_pd(y+i),sum0);
+		sum1 = _mm512_fmadd_pd(_mm512_loadu_pd(x+i+8),_mm512_loadu_pd(y+i+8),sum1);
+	}
+	for(; i<n; i+=8)
+	{
+		// the remainder is loaded with a mask, so that no element out of the arrays is read
+		__mmask8 mask = n-i >= 8 ? 0xFF : (__mmask8)((1<<(n-i))-1);
+		sum0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask,x+i),_mm512_maskz_loadu_pd(mask,y+i),sum0);
+	}
+	return dense_hsum_avx512(_mm512_add_pd(sum0,sum1));
+}
+
+__attribute__((target("avx512f")))
+static double dense_sqdist_avx512(const double *x, const double *y, int n)
+{
+	__m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+	int i = 0;
+	for(; i+16<=n; i+=16)
+	{
+		__m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(x+i),_mm512_loadu_pd(y+i));
+		__m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(x+i+8),_mm512_loadu_pd(y+i+8));
+		sum0 = _mm512_fmadd_pd(d0,d0,sum0);
+		sum1 = _mm512_fmadd_pd(d1,d1,sum1);
+	}
+	for(; i<n; i+=8)
+	{
+		__mmask8 mask = n-i >= 8 ? 0xFF : (__mmask8)((1<<(n-i))-1);
+		__m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask,x+i),_mm512_maskz_loadu_pd(mask,y+i));
+		sum0 = _mm512_fmadd_pd(d0,d0,sum0);
+	}
+	return dense_hsum_avx512(_mm512_add_pd(sum0,sum1));
+}
+#endif
+
+static int dense_simd_level()
+{
+#ifdef SVM_DENSE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+		return 3;
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return 2;
+	if(__builtin_cpu_supports("sse2"))
+		return 1;
+#endif
+	return 0;
+}
+
+static dense_func_t select_dense_func(dense_func_t generic, dense_func_t sse2, dense_func_t avx2, dense_func_t avx512)
+{
+	switch(dense_simd_level())
+	{
+		case 3: return avx512;
+		case 2: return avx2;
+		case 1: return sse2;
+		default: return generic;
+	}
+}
+
+#ifdef SVM_DENSE_X86
+static const dense_func_t dense_dot = select_dense_func(dense_dot_generic, dense_dot_sse2, dense_dot_avx2, dense_dot_avx512);
+static const dense_func_t dense_sqdist = select_dense_func(dense_sqdist_generic, dense_sqdist_sse2, dense_sqdist_avx2, dense_sqdist_avx512);
+#else
+static const dense_func_t dense_dot = dense_dot_generic;
+static const dense_func_t dense_sqdist = dense_sqdist_generic;
+#endif
+
+double svm_dense_dot(const double *x, const double *y, int n)
+{
+	return dense_dot(x,y,n);
+}
+
+double svm_dense_sqdist(const double *x, const double *y, int n)
+{
+	return dense_sqdist(x,y,n);
+}
+
 //
 // Kernel evaluation
 //
@@ -216,6 +527,7 @@ public:
 	{
 		swap(x[i],x[j]);
 		if(x_square) swap(x_square[i],x_square[j]);
+		if(x_dense) swap(x_dense[i],x_dense[j]);
 	}
 protected:
 
@@ -224,6 +536,9 @@ protected:
 private:
 	const svm_node **x;
 	double *x_square;
+	double **x_dense;	// rows of x as dense arrays of n_dense elements, or NULL if x is sparse
+	double *x_dense_space;
+	int n_dense;
 
 	// svm_parameter
 	const int kernel_type;
@@ -252,6 +567,22 @@ private:
 	{
 		return x[i][(int)(x[j][0].value)].value;
 	}
+	double kernel_linear_dense(int i, int j) const
+	{
+		return dense_dot(x_dense[i],x_dense[j],n_dense);
+	}
+	double kernel_poly_dense(int i, int j) const
+	{
+		return powi(gamma*dense_dot(x_dense[i],x_dense[j],n_dense)+coef0,degree);
+	}
+	double kernel_rbf_dense(int i, int j) const
+	{
+		return exp(-gamma*dense_sqdist(x_dense[i],x_dense[j],n_dense));
+	}
+	double kernel_sigmoid_dense(int i, int j) const
+	{
+		return tanh(gamma*dense_dot(x_dense[i],x_dense[j],n_dense)+coef0);
+	}
 };
 
 Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
@@ -279,7 +610,54 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 
 	clone(x,x_,l);
 
-	if(kernel_type == RBF)
+	// The rows are also stored as dense arrays when they take no more memory than the nodes,
+	// so that the kernel values are computed with the SIMD instructions.
+	x_dense = 0;
+	x_dense_space = 0;
+	n_dense = 0;
+	if(kernel_type != PRECOMPUTED)
+	{
+		size_t nnz = 0;
+		bool is_valid = true;
+		for(int i=0;i<l;i++)
+			for(const svm_node *p=x[i];p->index!=-1;p++)
+			{
+				if(p->index < 1) is_valid = false;
+				n_dense = max(n_dense,p->index);
+				nnz++;
+			}
+		if(is_valid && n_dense > 0 && (size_t)l*n_dense <= 2*nnz)
+		{
+			x_dense_space = new double[(size_t)l*n_dense];
+			memset(x_dense_space,0,sizeof(double)*l*n_dense);
+			x_dense = new double*[l];
+			for(int i=0;i<l;i++)
+			{
+				x_dense[i] = &x_dense_space[(size_t)i*n_dense];
+				for(const svm_node *p=x[i];p->index!=-1;p++)
+					x_dense[i][p->index-1] = p->value;
+			}
+			switch(kernel_type)
+			{
+				case LINEAR:
+					kernel_function = &Kernel::kernel_linear_dense;
+					break;
+				case POLY:
+					kernel_function = &Kernel::kernel_poly_dense;
+					break;
+				case RBF:
+					kernel_function = &Kernel::kernel_rbf_dense;
+					break;
+				case SIGMOID:
+					kernel_function = &Kernel::kernel_sigmoid_dense;
+					break;
+			}
+		}
+		else
+			n_dense = 0;
+	}
+
+	if(kernel_type == RBF && x_dense == 0)
 	{
 		x_square = new double[l];
 		for(int i=0;i<l;i++)
@@ -293,6 +671,8 @@ Kernel::~Kernel()
 {
 	delete[] x;
 	delete[] x_square;
+	delete[] x_dense;
+	delete[] x_dense_space;
 }
 
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -1447,9 +1827,33 @@ private:
 //
 // construct and solve various formulations
 //
+
+// Warm start: the initial alpha is clipped to [0,C] and the side of y_i = +1 or -1 with the larger sum is scaled down,
+// so that y^T alpha = 0 holds and the solver starts from a feasible point
+static void clip_init_alpha(int l, const schar *y, double Cp, double Cn, double *alpha)
+{
+	int i;
+	double sum_p = 0, sum_n = 0;
+	for(i=0;i<l;i++)
+	{
+		alpha[i] = min(max(alpha[i],0.0),y[i] > 0 ? Cp : Cn);
+		if(y[i] > 0) sum_p += alpha[i]; else sum_n += alpha[i];
+	}
+	if(sum_p > sum_n)
+	{
+		for(i=0;i<l;i++)
+			if(y[i] > 0) alpha[i] *= sum_n/sum_p;
+	}
+	else if(sum_n > sum_p)
+	{
+		for(i=0;i<l;i++)
+			if(y[i] < 0) alpha[i] *= sum_p/sum_n;
+	}
+}
+
 static void solve_c_svc(
 	const svm_problem *prob, const svm_parameter* param,
-	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn)
+	double *alpha, Solver::SolutionInfo* si, double Cp, double Cn, const double *init_alpha)
 {
 	int l = prob->l;
 	double *minus_ones = new double[l];
@@ -1459,10 +1863,12 @@ static void solve_c_svc(
 
 	for(i=0;i<l;i++)
 	{
-		alpha[i] = 0;
+		alpha[i] = init_alpha ? init_alpha[i] : 0;
 		minus_ones[i] = -1;
 		if(prob->y[i] > 0) y[i] = +1; else y[i] = -1;
 	}
+	if(init_alpha)
+		clip_init_alpha(l,y,Cp,Cn,alpha);
 
 	Solver s;
 	s.Solve(l, SVC_Q(*prob,*param,y), minus_ones, y,
@@ -1571,7 +1977,7 @@ static void solve_one_class(
 
 static void solve_epsilon_svr(
 	const svm_problem *prob, const svm_parameter *param,
-	double *alpha, Solver::SolutionInfo* si)
+	double *alpha, Solver::SolutionInfo* si, const double *init_alpha)
 {
 	int l = prob->l;
 	double *alpha2 = new double[2*l];
@@ -1581,14 +1987,16 @@ static void solve_epsilon_svr(
 
 	for(i=0;i<l;i++)
 	{
-		alpha2[i] = 0;
+		alpha2[i] = init_alpha ? max(init_alpha[i],0.0) : 0;
 		linear_term[i] = param->p - prob->y[i];
 		y[i] = 1;
 
-		alpha2[i+l] = 0;
+		alpha2[i+l] = init_alpha ? max(-init_alpha[i],0.0) : 0;
 		linear_term[i+l] = param->p + prob->y[i];
 		y[i+l] = -1;
 	}
+	if(init_alpha)
+		clip_init_alpha(2*l,y,param->C,param->C,alpha2);
 
 	Solver s;
 	s.Solve(2*l, SVR_Q(*prob,*param), linear_term, y,
@@ -1654,16 +2062,18 @@ struct decision_function
 	double rho;
 };
 
+// init_alpha is the initial alpha of C-SVC or alpha_i - alpha_i^* of epsilon-SVR for warm start, or NULL.
+// It is ignored by the other formulations.
 static decision_function svm_train_one(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn)
+	double Cp, double Cn, const double *init_alpha)
 {
 	double *alpha = Malloc(double,prob->l);
 	Solver::SolutionInfo si;
 	switch(param->svm_type)
 	{
 		case C_SVC:
-			solve_c_svc(prob,param,alpha,&si,Cp,Cn);
+			solve_c_svc(prob,param,alpha,&si,Cp,Cn,init_alpha);
 			break;
 		case NU_SVC:
 			solve_nu_svc(prob,param,alpha,&si);
@@ -1672,7 +2082,7 @@ static decision_function svm_train_one(
 			solve_one_class(prob,param,alpha,&si);
 			break;
 		case EPSILON_SVR:
-			solve_epsilon_svr(prob,param,alpha,&si);
+			solve_epsilon_svr(prob,param,alpha,&si,init_alpha);
 			break;
 		case NU_SVR:
 			solve_nu_svr(prob,param,alpha,&si);
@@ -1836,28 +2246,27 @@ static double sigmoid_predict(double decision_value, double A, double B)
 }
 
 // Method 2 from the multiclass_prob paper by Wu, Lin, and Weng to predict probabilities
-static void multiclass_probability(int k, double **r, double *p)
+// r and Q are k*k matrices stored by rows, and Qp has k elements.
+// Q and Qp are work arrays given by the caller.
+static void multiclass_probability(int k, const double *r, double *p, double *Q, double *Qp)
 {
 	int t,j;
 	int iter = 0, max_iter=max(100,k);
-	double **Q=Malloc(double *,k);
-	double *Qp=Malloc(double,k);
 	double pQp, eps=0.005/k;
 
 	for (t=0;t<k;t++)
 	{
 		p[t]=1.0/k;  // Valid if k = 1
-		Q[t]=Malloc(double,k);
-		Q[t][t]=0;
+		Q[t*k+t]=0;
 		for (j=0;j<t;j++)
 		{
-			Q[t][t]+=r[j][t]*r[j][t];
-			Q[t][j]=Q[j][t];
+			Q[t*k+t]+=r[j*k+t]*r[j*k+t];
+			Q[t*k+j]=Q[j*k+t];
 		}
 		for (j=t+1;j<k;j++)
 		{
-			Q[t][t]+=r[j][t]*r[j][t];
-			Q[t][j]=-r[j][t]*r[t][j];
+			Q[t*k+t]+=r[j*k+t]*r[j*k+t];
+			Q[t*k+j]=-r[j*k+t]*r[t*k+j];
 		}
 	}
 	for (iter=0;iter<max_iter;iter++)
@@ -1868,7 +2277,7 @@ static void multiclass_probability(int k, double **r, double *p)
 		{
 			Qp[t]=0;
 			for (j=0;j<k;j++)
-				Qp[t]+=Q[t][j]*p[j];
+				Qp[t]+=Q[t*k+j]*p[j];
 			pQp+=p[t]*Qp[t];
 		}
 		double max_error=0;
@@ -1882,27 +2291,94 @@ static void multiclass_probability(int k, double **r, double *p)
 
 		for (t=0;t<k;t++)
 		{
-			double diff=(-Qp[t]+pQp)/Q[t][t];
+			double diff=(-Qp[t]+pQp)/Q[t*k+t];
 			p[t]+=diff;
-			pQp=(pQp+diff*(diff*Q[t][t]+2*Qp[t]))/(1+diff)/(1+diff);
+			pQp=(pQp+diff*(diff*Q[t*k+t]+2*Qp[t]))/(1+diff)/(1+diff);
 			for (j=0;j<k;j++)
 			{
-				Qp[j]=(Qp[j]+diff*Q[t][j])/(1+diff);
+				Qp[j]=(Qp[j]+diff*Q[t*k+j])/(1+diff);
 				p[j]/=(1+diff);
 			}
 		}
 	}
 	if (iter>=max_iter)
 		info("Exceeds max_iter in multiclass_prob\n");
-	for(t=0;t<k;t++) free(Q[t]);
-	free(Q);
-	free(Qp);
 }
 
 // Using cross-validation decision values to get parameters for SVC probability estimates
+// Cross-validation decision values of a fold for svm_binary_svc_probability
+static void svm_binary_svc_probability_fold(
+	const svm_problem *prob, const svm_parameter *param,
+	double Cp, double Cn, const int *perm, int begin, int end, double *dec_values)
+{
+	int j,k;
+	struct svm_problem subprob;
+
+	subprob.l = prob->l-(end-begin);
+	subprob.x = Malloc(struct svm_node*,subprob.l);
+	subprob.y = Malloc(double,subprob.l);
+
+	k=0;
+	for(j=0;j<begin;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	for(j=end;j<prob->l;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	int p_count=0,n_count=0;
+	for(j=0;j<k;j++)
+		if(subprob.y[j]>0)
+			p_count++;
+		else
+			n_count++;
+
+	if(p_count==0 && n_count==0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 0;
+	else if(p_count > 0 && n_count == 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = 1;
+	else if(p_count == 0 && n_count > 0)
+		for(j=begin;j<end;j++)
+			dec_values[perm[j]] = -1;
+	else
+	{
+		svm_parameter subparam = *param;
+		subparam.probability=0;
+		subparam.C=1.0;
+		subparam.nr_weight=2;
+		subparam.weight_label = Malloc(int,2);
+		subparam.weight = Malloc(double,2);
+		subparam.weight_label[0]=+1;
+		subparam.weight_label[1]=-1;
+		subparam.weight[0]=Cp;
+		subparam.weight[1]=Cn;
+		subparam.nr_thread=1;
+		struct svm_model *submodel = svm_train(&subprob,&subparam);
+		for(j=begin;j<end;j++)
+		{
+			svm_predict_values(submodel,prob->x[perm[j]],&(dec_values[perm[j]]));
+			// ensure +1 -1 order; reason not using CV subroutine
+			dec_values[perm[j]] *= submodel->label[0];
+		}
+		svm_free_and_destroy_model(&submodel);
+		svm_destroy_param(&subparam);
+	}
+	free(subprob.x);
+	free(subprob.y);
+}
+
+// Cross-validation decision values for probability estimates
+// The folds are trained on param->nr_thread threads, and each fold writes the decision values of its own samples.
 static void svm_binary_svc_probability(
 	const svm_problem *prob, const svm_parameter *param,
-	double Cp, double Cn, double& probA, double& probB)
+	double Cp, double Cn, double& probA, double& probB, svm_rand rng)
 {
 	int i;
 	int nr_fold = 5;
@@ -1913,74 +2389,19 @@ static void svm_binary_svc_probability(
 	for(i=0;i<prob->l;i++) perm[i]=i;
 	for(i=0;i<prob->l;i++)
 	{
-		int j = i+rand()%(prob->l-i);
+		int j = i+rand_int(&rng,prob->l-i);
 		swap(perm[i],perm[j]);
 	}
-	for(i=0;i<nr_fold;i++)
+
+	int nr_fold_thread = min(max(param->nr_thread,1),nr_fold);
+	svm_parameter fold_param = *param;
+	fold_param.cache_size = param->cache_size/nr_fold_thread;
+	run_parallel(nr_fold_thread,nr_fold,[&](int i)
 	{
 		int begin = i*prob->l/nr_fold;
 		int end = (i+1)*prob->l/nr_fold;
-		int j,k;
-		struct svm_problem subprob;
-
-		subprob.l = prob->l-(end-begin);
-		subprob.x = Malloc(struct svm_node*,subprob.l);
-		subprob.y = Malloc(double,subprob.l);
-
-		k=0;
-		for(j=0;j<begin;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		for(j=end;j<prob->l;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		int p_count=0,n_count=0;
-		for(j=0;j<k;j++)
-			if(subprob.y[j]>0)
-				p_count++;
-			else
-				n_count++;
-
-		if(p_count==0 && n_count==0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 0;
-		else if(p_count > 0 && n_count == 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = 1;
-		else if(p_count == 0 && n_count > 0)
-			for(j=begin;j<end;j++)
-				dec_values[perm[j]] = -1;
-		else
-		{
-			svm_parameter subparam = *param;
-			subparam.probability=0;
-			subparam.C=1.0;
-			subparam.nr_weight=2;
-			subparam.weight_label = Malloc(int,2);
-			subparam.weight = Malloc(double,2);
-			subparam.weight_label[0]=+1;
-			subparam.weight_label[1]=-1;
-			subparam.weight[0]=Cp;
-			subparam.weight[1]=Cn;
-			struct svm_model *submodel = svm_train(&subprob,&subparam);
-			for(j=begin;j<end;j++)
-			{
-				svm_predict_values(submodel,prob->x[perm[j]],&(dec_values[perm[j]]));
-				// ensure +1 -1 order; reason not using CV subroutine
-				dec_values[perm[j]] *= submodel->label[0];
-			}
-			svm_free_and_destroy_model(&submodel);
-			svm_destroy_param(&subparam);
-		}
-		free(subprob.x);
-		free(subprob.y);
-	}
+		svm_binary_svc_probability_fold(prob,&fold_param,Cp,Cn,perm,begin,end,dec_values);
+	});
 	sigmoid_train(prob->l,dec_values,prob->y,probA,probB);
 	free(dec_values);
 	free(perm);
@@ -2065,7 +2486,7 @@ static int svm_one_class_probability(const svm_problem *prob, const svm_model *m
 
 // Return parameter of a Laplace distribution
 static double svm_svr_probability(
-	const svm_problem *prob, const svm_parameter *param)
+	const svm_problem *prob, const svm_parameter *param, svm_rand *rng)
 {
 	int i;
 	int nr_fold = 5;
@@ -2074,7 +2495,7 @@ static double svm_svr_probability(
 
 	svm_parameter newparam = *param;
 	newparam.probability = 0;
-	svm_cross_validation(prob,&newparam,nr_fold,ymv);
+	svm_cross_validation_rng(prob,&newparam,nr_fold,ymv,rng);
 	for(i=0;i<prob->l;i++)
 	{
 		ymv[i]=prob->y[i]-ymv[i];
@@ -2176,8 +2597,21 @@ static void svm_group_classes(const svm_problem *prob, int *nr_class_ret, int **
 //
 // Interface functions
 //
-svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+// svm_train_rng and svm_cross_validation_rng draw the random numbers from the generator rng if given,
+// or from the generator seeded with rand() otherwise.
+//
+// The dual coefficients of init_model, if given, are the initial point of the solvers of C-SVC and epsilon-SVR.
+// Its support vectors are mapped to the training samples with sv_indices, and the pairs of classes with label.
+//
+svm_model *svm_train_rng(const svm_problem *prob, const svm_parameter *param, const svm_model *init_model, svm_rand *rng)
 {
+	svm_rand local_rng;
+	if(rng == NULL)
+	{
+		svm_srand(&local_rng,(unsigned int)rand());
+		rng = &local_rng;
+	}
+
 	svm_model *model = Malloc(svm_model,1);
 	model->param = *param;
 	model->free_sv = 0;	// XXX
@@ -2194,7 +2628,19 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		model->prob_density_marks = NULL;
 		model->sv_coef = Malloc(double *,1);
 
-		decision_function f = svm_train_one(prob,param,0,0);
+		double *init_alpha = NULL;
+		if(init_model && init_model->sv_coef && init_model->sv_indices && param->svm_type == EPSILON_SVR)
+		{
+			init_alpha = Malloc(double,prob->l);
+			for(int i=0;i<prob->l;i++)
+				init_alpha[i] = 0;
+			for(int s=0;s<init_model->l;s++)
+				if(init_model->sv_indices[s] >= 1 && init_model->sv_indices[s] <= prob->l)
+					init_alpha[init_model->sv_indices[s]-1] = init_model->sv_coef[0][s];
+		}
+
+		decision_function f = svm_train_one(prob,param,0,0,init_alpha);
+		free(init_alpha);
 		model->rho = Malloc(double,1);
 		model->rho[0] = f.rho;
 
@@ -2221,7 +2667,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 		    param->svm_type == NU_SVR))
 		{
 			model->probA = Malloc(double,1);
-			model->probA[0] = svm_svr_probability(prob,param);
+			model->probA[0] = svm_svr_probability(prob,param,rng);
 		}
 		else if(param->probability && param->svm_type == ONE_CLASS)
 		{
@@ -2287,42 +2733,163 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 			probB=Malloc(double,nr_class*(nr_class-1)/2);
 		}
 
+		int nr_pair = nr_class*(nr_class-1)/2;
+		int *pair_i = Malloc(int,nr_pair);
+		int *pair_j = Malloc(int,nr_pair);
 		int p = 0;
 		for(i=0;i<nr_class;i++)
 			for(int j=i+1;j<nr_class;j++)
 			{
-				svm_problem sub_prob;
-				int si = start[i], sj = start[j];
-				int ci = count[i], cj = count[j];
-				sub_prob.l = ci+cj;
-				sub_prob.x = Malloc(svm_node *,sub_prob.l);
-				sub_prob.y = Malloc(double,sub_prob.l);
-				int k;
-				for(k=0;k<ci;k++)
+				pair_i[p] = i;
+				pair_j[p] = j;
+				++p;
+			}
+
+		// the probability estimate of each pair shuffles its samples from the state of the generator
+		// in the serial training, that is after the shuffles of the preceding pairs
+		svm_rand *pair_rng = NULL;
+		if(param->probability)
+		{
+			pair_rng = Malloc(svm_rand,nr_pair);
+			for(p=0;p<nr_pair;p++)
+			{
+				pair_rng[p] = *rng;
+				rand_skip(rng,count[pair_i[p]]+count[pair_j[p]]);
+			}
+		}
+
+		// the pairs are trained from the largest subproblem, so that it does not start last on a thread
+		int *pair_order = Malloc(int,nr_pair);
+		for(p=0;p<nr_pair;p++)
+		{
+			int q = p;
+			int size = count[pair_i[p]]+count[pair_j[p]];
+			for(;q>0 && count[pair_i[pair_order[q-1]]]+count[pair_j[pair_order[q-1]]] < size;q--)
+				pair_order[q] = pair_order[q-1];
+			pair_order[q] = p;
+		}
+
+		// for warm start, the classes and the training samples are mapped to those of init_model
+		int *init_class = NULL;
+		int *init_sv = NULL;
+		int *init_sv_class = NULL;
+		if(init_model && init_model->sv_coef && init_model->sv_indices && init_model->label && init_model->nSV &&
+		   param->svm_type == C_SVC)
+		{
+			init_class = Malloc(int,nr_class);
+			for(i=0;i<nr_class;i++)
+			{
+				init_class[i] = -1;
+				for(int c=0;c<init_model->nr_class;c++)
+					if(init_model->label[c] == label[i])
+						init_class[i] = c;
+			}
+			init_sv = Malloc(int,l);
+			for(i=0;i<l;i++)
+				init_sv[i] = -1;
+			init_sv_class = Malloc(int,init_model->l);
+			for(int c=0,s=0;c<init_model->nr_class;c++)
+				for(int k=0;k<init_model->nSV[c] && s<init_model->l;k++,s++)
 				{
-					sub_prob.x[k] = x[si+k];
-					sub_prob.y[k] = +1;
+					init_sv_class[s] = c;
+					if(init_model->sv_indices[s] >= 1 && init_model->sv_indices[s] <= l)
+						init_sv[init_model->sv_indices[s]-1] = s;
 				}
-				for(k=0;k<cj;k++)
+		}
+
+		// the concurrent solvers share the threads and the kernel cache budget
+		int nr_thread = min(max(param->nr_thread,1),max(nr_pair,1));
+		svm_parameter pair_param = *param;
+		if(nr_thread > 1)
+		{
+			pair_param.cache_size = param->cache_size/nr_thread;
+			pair_param.nr_thread = max(param->nr_thread/nr_thread,1);
+		}
+
+		run_parallel(nr_thread,nr_pair,[&](int task)
+		{
+			int p = pair_order[task];
+			int i = pair_i[p], j = pair_j[p];
+			svm_problem sub_prob;
+			int si = start[i], sj = start[j];
+			int ci = count[i], cj = count[j];
+			sub_prob.l = ci+cj;
+			sub_prob.x = Malloc(svm_node *,sub_prob.l);
+			sub_prob.y = Malloc(double,sub_prob.l);
+			int k;
+			for(k=0;k<ci;k++)
+			{
+				sub_prob.x[k] = x[si+k];
+				sub_prob.y[k] = +1;
+			}
+			for(k=0;k<cj;k++)
+			{
+				sub_prob.x[ci+k] = x[sj+k];
+				sub_prob.y[ci+k] = -1;
+			}
+
+			// the support vectors of class a of init_model have the coefficients for class b in sv_coef[b > a ? b-1 : b]
+			double *init_alpha = NULL;
+			if(init_class && init_class[i] >= 0 && init_class[j] >= 0)
+			{
+				int a = init_class[i], b = init_class[j];
+				init_alpha = Malloc(double,sub_prob.l);
+				for(k=0;k<sub_prob.l;k++)
 				{
-					sub_prob.x[ci+k] = x[sj+k];
-					sub_prob.y[ci+k] = -1;
+					int s = init_sv[perm[k < ci ? si+k : sj+k-ci]];
+					int c = k < ci ? a : b;
+					int row = k < ci ? (b > a ? b-1 : b) : (a > b ? a-1 : a);
+					init_alpha[k] = s >= 0 && init_sv_class[s] == c ? fabs(init_model->sv_coef[row][s]) : 0;
 				}
+			}
 
+			if(param->probability && pair_param.nr_thread > 1)
+			{
+				// the calibration folds and the pair itself are trained concurrently
+				svm_parameter calib_param = pair_param;
+				calib_param.nr_thread = pair_param.nr_thread-1;
+				calib_param.cache_size = pair_param.cache_size*calib_param.nr_thread/pair_param.nr_thread;
+				svm_parameter one_param = pair_param;
+				one_param.cache_size = pair_param.cache_size/pair_param.nr_thread;
+				run_parallel(2,2,[&](int task)
+				{
+					if(task == 0)
+						svm_binary_svc_probability(&sub_prob,&calib_param,weighted_C[i],weighted_C[j],probA[p],probB[p],pair_rng[p]);
+					else
+						f[p] = svm_train_one(&sub_prob,&one_param,weighted_C[i],weighted_C[j],init_alpha);
+				});
+			}
+			else
+			{
 				if(param->probability)
-					svm_binary_svc_probability(&sub_prob,param,weighted_C[i],weighted_C[j],probA[p],probB[p]);
+					svm_binary_svc_probability(&sub_prob,&pair_param,weighted_C[i],weighted_C[j],probA[p],probB[p],pair_rng[p]);
 
-				f[p] = svm_train_one(&sub_prob,param,weighted_C[i],weighted_C[j]);
-				for(k=0;k<ci;k++)
-					if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
-						nonzero[si+k] = true;
-				for(k=0;k<cj;k++)
-					if(!nonzero[sj+k] && fabs(f[p].alpha[ci+k]) > 0)
-						nonzero[sj+k] = true;
-				free(sub_prob.x);
-				free(sub_prob.y);
-				++p;
+				f[p] = svm_train_one(&sub_prob,&pair_param,weighted_C[i],weighted_C[j],init_alpha);
 			}
+			free(init_alpha);
+			free(sub_prob.x);
+			free(sub_prob.y);
+		});
+
+		for(p=0;p<nr_pair;p++)
+		{
+			int si = start[pair_i[p]], sj = start[pair_j[p]];
+			int ci = count[pair_i[p]], cj = count[pair_j[p]];
+			int k;
+			for(k=0;k<ci;k++)
+				if(!nonzero[si+k] && fabs(f[p].alpha[k]) > 0)
+					nonzero[si+k] = true;
+			for(k=0;k<cj;k++)
+				if(!nonzero[sj+k] && fabs(f[p].alpha[ci+k]) > 0)
+					nonzero[sj+k] = true;
+		}
+		free(pair_i);
+		free(pair_j);
+		free(pair_rng);
+		free(pair_order);
+		free(init_class);
+		free(init_sv);
+		free(init_sv_class);
 
 		// build output
 
@@ -2434,20 +3001,28 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 	return model;
 }
 
+svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
+{
+	return svm_train_rng(prob,param,NULL,NULL);
+}
+
+svm_model *svm_train_warm(const svm_problem *prob, const svm_parameter *param, const svm_model *init_model)
+{
+	return svm_train_rng(prob,param,init_model,NULL);
+}
+
 // Stratified cross validation
-void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+// The samples are shuffled into perm, and fold i has perm[fold_start[i]...fold_start[i+1]-1]. Return the number of folds.
+static int svm_cross_validation_split(const svm_problem *prob, const svm_parameter *param, int nr_fold, int *perm, int *fold_start, svm_rand *rng)
 {
 	int i;
-	int *fold_start;
 	int l = prob->l;
-	int *perm = Malloc(int,l);
 	int nr_class;
 	if (nr_fold > l)
 	{
 		fprintf(stderr,"WARNING: # folds (%d) > # data (%d). Will use # folds = # data instead (i.e., leave-one-out cross validation)\n", nr_fold, l);
 		nr_fold = l;
 	}
-	fold_start = Malloc(int,nr_fold+1);
 	// stratified cv may not give leave-one-out rate
 	// Each class to l folds -> some folds may have zero elements
 	if((param->svm_type == C_SVC ||
@@ -2467,7 +3042,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for (c=0; c<nr_class; c++)
 			for(i=0;i<count[c];i++)
 			{
-				int j = i+rand()%(count[c]-i);
+				int j = i+rand_int(rng,count[c]-i);
 				swap(index[start[c]+j],index[start[c]+i]);
 			}
 		for(i=0;i<nr_fold;i++)
@@ -2504,53 +3079,186 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		for(i=0;i<l;i++) perm[i]=i;
 		for(i=0;i<l;i++)
 		{
-			int j = i+rand()%(l-i);
+			int j = i+rand_int(rng,l-i);
 			swap(perm[i],perm[j]);
 		}
 		for(i=0;i<=nr_fold;i++)
 			fold_start[i]=i*l/nr_fold;
 	}
 
-	for(i=0;i<nr_fold;i++)
-	{
-		int begin = fold_start[i];
-		int end = fold_start[i+1];
-		int j,k;
-		struct svm_problem subprob;
+	return nr_fold;
+}
 
-		subprob.l = l-(end-begin);
-		subprob.x = Malloc(struct svm_node*,subprob.l);
-		subprob.y = Malloc(double,subprob.l);
+// The number of random numbers drawn by svm_train_rng on the samples without fold i
+static long long svm_cross_validation_fold_draws(const svm_problem *prob, const svm_parameter *param, const int *perm, const int *fold_start, int i)
+{
+	if(!param->probability)
+		return 0;
+	int l = prob->l-(fold_start[i+1]-fold_start[i]);
+	if(param->svm_type == EPSILON_SVR || param->svm_type == NU_SVR)
+		return l;	// the shuffle of the cross validation in svm_svr_probability
+	if(param->svm_type != C_SVC && param->svm_type != NU_SVC)
+		return 0;
 
-		k=0;
-		for(j=0;j<begin;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		for(j=end;j<l;j++)
-		{
-			subprob.x[k] = prob->x[perm[j]];
-			subprob.y[k] = prob->y[perm[j]];
-			++k;
-		}
-		struct svm_model *submodel = svm_train(&subprob,param);
-		if(param->probability &&
-		   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
+	// each pair of classes shuffles its samples in svm_binary_svc_probability, so each sample is shuffled nr_class-1 times
+	int max_nr_class = 16;
+	int nr_class = 0;
+	int *label = Malloc(int,max_nr_class);
+	for(int j=0;j<prob->l;j++)
+	{
+		if(j == fold_start[i])
+			j = fold_start[i+1];
+		if(j >= prob->l)
+			break;
+		int this_label = (int)prob->y[perm[j]];
+		int c;
+		for(c=0;c<nr_class;c++)
+			if(this_label == label[c])
+				break;
+		if(c == nr_class)
 		{
-			double *prob_estimates=Malloc(double,svm_get_nr_class(submodel));
-			for(j=begin;j<end;j++)
-				target[perm[j]] = svm_predict_probability(submodel,prob->x[perm[j]],prob_estimates);
-			free(prob_estimates);
+			if(nr_class == max_nr_class)
+			{
+				max_nr_class *= 2;
+				label = (int *)realloc(label,max_nr_class*sizeof(int));
+			}
+			label[nr_class++] = this_label;
 		}
-		else
-			for(j=begin;j<end;j++)
-				target[perm[j]] = svm_predict(submodel,prob->x[perm[j]]);
-		svm_free_and_destroy_model(&submodel);
-		free(subprob.x);
-		free(subprob.y);
 	}
+	free(label);
+	return nr_class > 1 ? (long long)(nr_class-1)*l : 0;
+}
+
+// Train the model without fold i and predict the samples in fold i
+static void svm_cross_validation_fold(const svm_problem *prob, const svm_parameter *param, const int *perm, const int *fold_start, int i, double *target, svm_rand rng)
+{
+	int l = prob->l;
+	int begin = fold_start[i];
+	int end = fold_start[i+1];
+	int j,k;
+	struct svm_problem subprob;
+
+	subprob.l = l-(end-begin);
+	subprob.x = Malloc(struct svm_node*,subprob.l);
+	subprob.y = Malloc(double,subprob.l);
+
+	k=0;
+	for(j=0;j<begin;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	for(j=end;j<l;j++)
+	{
+		subprob.x[k] = prob->x[perm[j]];
+		subprob.y[k] = prob->y[perm[j]];
+		++k;
+	}
+	struct svm_model *submodel = svm_train_rng(&subprob,param,NULL,&rng);
+	if(param->probability &&
+	   (param->svm_type == C_SVC || param->svm_type == NU_SVC))
+	{
+		double *prob_estimates=Malloc(double,svm_get_nr_class(submodel));
+		for(j=begin;j<end;j++)
+			target[perm[j]] = svm_predict_probability(submodel,prob->x[perm[j]],prob_estimates);
+		free(prob_estimates);
+	}
+	else
+		for(j=begin;j<end;j++)
+			target[perm[j]] = svm_predict(submodel,prob->x[perm[j]]);
+	svm_free_and_destroy_model(&submodel);
+	free(subprob.x);
+	free(subprob.y);
+}
+
+void svm_cross_validation_rng(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target, svm_rand *rng)
+{
+	int i;
+	svm_rand local_rng;
+	if(rng == NULL)
+	{
+		svm_srand(&local_rng,(unsigned int)rand());
+		rng = &local_rng;
+	}
+	int *perm = Malloc(int,prob->l);
+	int *fold_start = Malloc(int,min(nr_fold,prob->l)+1);
+	nr_fold = svm_cross_validation_split(prob,param,nr_fold,perm,fold_start,rng);
+
+	// each fold draws from the state of the generator in the serial cross validation, that is after the preceding folds
+	svm_rand *fold_rng = Malloc(svm_rand,nr_fold);
+	for(i=0;i<nr_fold;i++)
+	{
+		fold_rng[i] = *rng;
+		rand_skip(rng,svm_cross_validation_fold_draws(prob,param,perm,fold_start,i));
+	}
+
+	// the concurrent folds share the threads and the kernel cache budget
+	int nr_fold_thread = min(max(param->nr_thread,1),nr_fold);
+	svm_parameter fold_param = *param;
+	if(nr_fold_thread > 1)
+	{
+		fold_param.cache_size = param->cache_size/nr_fold_thread;
+		fold_param.nr_thread = max(param->nr_thread/nr_fold_thread,1);
+	}
+
+	run_parallel(nr_fold_thread,nr_fold,[&](int i)
+	{
+		svm_cross_validation_fold(prob,&fold_param,perm,fold_start,i,target,fold_rng[i]);
+	});
+	free(fold_rng);
+	free(fold_start);
+	free(perm);
+}
+
+void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, int nr_fold, double *target)
+{
+	svm_cross_validation_rng(prob,param,nr_fold,target,NULL);
+}
+
+// Cross validation of the parameter candidates on the same folds.
+// The folds are split with params[0], and target[p*l+i] is the prediction for sample i with params[p].
+// The random numbers are drawn from the generator rng if given, or from the generator seeded with rand() otherwise.
+void svm_grid_search(const svm_problem *prob, const svm_parameter *params, int nr_param, int nr_fold, int nr_thread, double *target, svm_rand *rng)
+{
+	int i,p;
+	svm_rand local_rng;
+	if(rng == NULL)
+	{
+		svm_srand(&local_rng,(unsigned int)rand());
+		rng = &local_rng;
+	}
+	int l = prob->l;
+	int *perm = Malloc(int,l);
+	int *fold_start = Malloc(int,min(nr_fold,l)+1);
+	nr_fold = svm_cross_validation_split(prob,&params[0],nr_fold,perm,fold_start,rng);
+
+	// each task draws from the state of the generator in the serial search, that is after the preceding candidates and folds
+	int nr_task = nr_param*nr_fold;
+	svm_rand *task_rng = Malloc(svm_rand,nr_task);
+	for(i=0;i<nr_task;i++)
+	{
+		task_rng[i] = *rng;
+		rand_skip(rng,svm_cross_validation_fold_draws(prob,&params[i/nr_fold],perm,fold_start,i%nr_fold));
+	}
+
+	// the concurrent tasks share the threads and the kernel cache budget of each candidate
+	int nr_task_thread = min(max(nr_thread,1),nr_task);
+	svm_parameter *task_params = Malloc(svm_parameter,nr_param);
+	for(p=0;p<nr_param;p++)
+	{
+		task_params[p] = params[p];
+		task_params[p].nr_thread = max(nr_thread/nr_task_thread,1);
+		if(nr_task_thread > 1)
+			task_params[p].cache_size = params[p].cache_size/nr_task_thread;
+	}
+
+	run_parallel(nr_task_thread,nr_task,[&](int t)
+	{
+		svm_cross_validation_fold(prob,&task_params[t/nr_fold],perm,fold_start,t%nr_fold,&target[(size_t)(t/nr_fold)*l],task_rng[t]);
+	});
+	free(task_params);
+	free(task_rng);
 	free(fold_start);
 	free(perm);
 }
@@ -2598,6 +3306,29 @@ double svm_get_svr_probability(const svm_model *model)
 }
 
 double svm_predict_values(const svm_model *model, const svm_node *x, double* dec_values)
+{
+	if(model->param.svm_type == ONE_CLASS ||
+	   model->param.svm_type == EPSILON_SVR ||
+	   model->param.svm_type == NU_SVR)
+		return svm_predict_values_with_buffer(model, x, dec_values, NULL, NULL, NULL);
+
+	int nr_class = model->nr_class;
+	double *kvalue = Malloc(double,model->l);
+	int *start = Malloc(int,nr_class);
+	int *vote = Malloc(int,nr_class);
+	double pred_result = svm_predict_values_with_buffer(model, x, dec_values, kvalue, start, vote);
+	free(kvalue);
+	free(start);
+	free(vote);
+	return pred_result;
+}
+
+// Same as svm_predict_values, but the work arrays are given by the caller so that
+// predicting many instances does not allocate memory for each of them.
+// kvalue has model->l elements, and start and vote have model->nr_class elements.
+// They are not used and can be NULL for one-class SVM and regression.
+double svm_predict_values_with_buffer(const svm_model *model, const svm_node *x, double* dec_values,
+				      double *kvalue, int *start, int *vote)
 {
 	int i;
 	if(model->param.svm_type == ONE_CLASS ||
@@ -2624,19 +3355,16 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 		int nr_class = model->nr_class;
 		int l = model->l;
 
-		double *kvalue = Malloc(double,l);
 #ifdef _OPENMP
 #pragma omp parallel for private(i) schedule(guided)
 #endif
 		for(i=0;i<l;i++)
 			kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
 
-		int *start = Malloc(int,nr_class);
 		start[0] = 0;
 		for(i=1;i<nr_class;i++)
 			start[i] = start[i-1]+model->nSV[i-1];
 
-		int *vote = Malloc(int,nr_class);
 		for(i=0;i<nr_class;i++)
 			vote[i] = 0;
 
@@ -2672,9 +3400,6 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 			if(vote[i] > vote[vote_max_idx])
 				vote_max_idx = i;
 
-		free(kvalue);
-		free(start);
-		free(vote);
 		return model->label[vote_max_idx];
 	}
 }
@@ -2700,51 +3425,86 @@ double svm_predict_probability(
 	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
 	    model->probA!=NULL && model->probB!=NULL)
 	{
-		int i;
 		int nr_class = model->nr_class;
 		double *dec_values = Malloc(double, nr_class*(nr_class-1)/2);
 		svm_predict_values(model, x, dec_values);
+		double pred_result = svm_predict_probability_from_dec_values(model, dec_values, prob_estimates);
+		free(dec_values);
+		return pred_result;
+	}
+	else if(model->param.svm_type == ONE_CLASS && model->prob_density_marks!=NULL)
+	{
+		double dec_value;
+		svm_predict_values(model,x,&dec_value);
+		return svm_predict_probability_from_dec_values(model, &dec_value, prob_estimates);
+	}
+	else
+		return svm_predict(model, x);
+}
+
+// Probability estimates from the decision values given by svm_predict_values.
+// This is for the model that svm_check_probability_model returns true except for regression.
+double svm_predict_probability_from_dec_values(
+	const svm_model *model, const double *dec_values, double *prob_estimates)
+{
+	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+	    model->probA!=NULL && model->probB!=NULL)
+	{
+		int nr_class = model->nr_class;
+		double *prob_buffer = Malloc(double,nr_class*(2*nr_class+1));
+		double pred_result = svm_predict_probability_from_dec_values_with_buffer(model, dec_values, prob_estimates, prob_buffer);
+		free(prob_buffer);
+		return pred_result;
+	}
+	return svm_predict_probability_from_dec_values_with_buffer(model, dec_values, prob_estimates, NULL);
+}
+
+// Same as svm_predict_probability_from_dec_values, but the work array is given by the caller so that
+// predicting many instances does not allocate memory for each of them.
+// prob_buffer has nr_class*(2*nr_class+1) elements for the pairwise probabilities and the work arrays of
+// multiclass_probability. It is not used and can be NULL for one-class SVM and regression.
+double svm_predict_probability_from_dec_values_with_buffer(
+	const svm_model *model, const double *dec_values, double *prob_estimates, double *prob_buffer)
+{
+	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
+	    model->probA!=NULL && model->probB!=NULL)
+	{
+		int i;
+		int nr_class = model->nr_class;
 
 		double min_prob=1e-7;
-		double **pairwise_prob=Malloc(double *,nr_class);
-		for(i=0;i<nr_class;i++)
-			pairwise_prob[i]=Malloc(double,nr_class);
+		double *pairwise_prob=prob_buffer;
 		int k=0;
 		for(i=0;i<nr_class;i++)
 			for(int j=i+1;j<nr_class;j++)
 			{
-				pairwise_prob[i][j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
-				pairwise_prob[j][i]=1-pairwise_prob[i][j];
+				pairwise_prob[i*nr_class+j]=min(max(sigmoid_predict(dec_values[k],model->probA[k],model->probB[k]),min_prob),1-min_prob);
+				pairwise_prob[j*nr_class+i]=1-pairwise_prob[i*nr_class+j];
 				k++;
 			}
 		if (nr_class == 2)
 		{
-			prob_estimates[0] = pairwise_prob[0][1];
-			prob_estimates[1] = pairwise_prob[1][0];
+			prob_estimates[0] = pairwise_prob[1];
+			prob_estimates[1] = pairwise_prob[2];
 		}
 		else
-			multiclass_probability(nr_class,pairwise_prob,prob_estimates);
+			multiclass_probability(nr_class,pairwise_prob,prob_estimates,
+					       &prob_buffer[nr_class*nr_class],&prob_buffer[2*nr_class*nr_class]);
 
 		int prob_max_idx = 0;
 		for(i=1;i<nr_class;i++)
 			if(prob_estimates[i] > prob_estimates[prob_max_idx])
 				prob_max_idx = i;
-		for(i=0;i<nr_class;i++)
-			free(pairwise_prob[i]);
-		free(dec_values);
-		free(pairwise_prob);
 		return model->label[prob_max_idx];
 	}
 	else if(model->param.svm_type == ONE_CLASS && model->prob_density_marks!=NULL)
 	{
-		double dec_value;
-		double pred_result = svm_predict_values(model,x,&dec_value);
-		prob_estimates[0] = predict_one_class_probability(model,dec_value);
+		prob_estimates[0] = predict_one_class_probability(model,dec_values[0]);
 		prob_estimates[1] = 1-prob_estimates[0];
-		return pred_result;
+		return (dec_values[0]>0)?1:-1;
 	}
 	else
-		return svm_predict(model, x);
+		return dec_values[0];
 }
 
 static const char *svm_type_table[] =
@@ -2898,6 +3658,7 @@ bool read_model_header(FILE *fp, svm_model* model)
 	param.nr_weight = 0;
 	param.weight_label = NULL;
 	param.weight = NULL;
+	param.nr_thread = 1;
 
 	char cmd[81];
 	while(1)
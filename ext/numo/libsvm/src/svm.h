@@ -44,6 +44,7 @@ struct svm_parameter
 	double p;	/* for EPSILON_SVR */
 	int shrinking;	/* use the shrinking heuristics */
 	int probability; /* do probability estimates */
+	int nr_thread;	/* number of threads for training */
 };
 
 //
@@ -72,8 +73,23 @@ struct svm_model
 				/* 0 if svm_model is created by svm_train */
 };
 
+//
+// svm_rand: the state of the random number generator used in training
+//
+struct svm_rand
+{
+	int state[31];
+	int front, rear;
+};
+
+void svm_srand(struct svm_rand *rng, unsigned int seed);
+
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
+struct svm_model *svm_train_warm(const struct svm_problem *prob, const struct svm_parameter *param, const struct svm_model *init_model);
+struct svm_model *svm_train_rng(const struct svm_problem *prob, const struct svm_parameter *param, const struct svm_model *init_model, struct svm_rand *rng);
 void svm_cross_validation(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target);
+void svm_cross_validation_rng(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target, struct svm_rand *rng);
+void svm_grid_search(const struct svm_problem *prob, const struct svm_parameter *params, int nr_param, int nr_fold, int nr_thread, double *target, struct svm_rand *rng);
 
 int svm_save_model(const char *model_file_name, const struct svm_model *model);
 struct svm_model *svm_load_model(const char *model_file_name);
@@ -86,8 +102,11 @@ int svm_get_nr_sv(const struct svm_model *model);
 double svm_get_svr_probability(const struct svm_model *model);
 
 double svm_predict_values(const struct svm_model *model, const struct svm_node *x, double* dec_values);
+double svm_predict_values_with_buffer(const struct svm_model *model, const struct svm_node *x, double* dec_values, double *kvalue, int *start, int *vote);
 double svm_predict(const struct svm_model *model, const struct svm_node *x);
 double svm_predict_probability(const struct svm_model *model, const struct svm_node *x, double* prob_estimates);
+double svm_predict_probability_from_dec_values(const struct svm_model *model, const double *dec_values, double* prob_estimates);
+double svm_predict_probability_from_dec_values_with_buffer(const struct svm_model *model, const double *dec_values, double* prob_estimates, double *prob_buffer);
 
 void svm_free_model_content(struct svm_model *model_ptr);
 void svm_free_and_destroy_model(struct svm_model **model_ptr_ptr);
@@ -98,6 +117,9 @@ int svm_check_probability_model(const struct svm_model *model);
 
 void svm_set_print_string_function(void (*print_func)(const char *));
 
+double svm_dense_dot(const double *x, const double *y, int n);
+double svm_dense_sqdist(const double *x, const double *y, int n);
+
 #ifdef __cplusplus
 }
 #endif
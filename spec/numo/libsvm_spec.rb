@@ -1,5 +1,7 @@
 # frozen_string_literal: true
 
+require 'tmpdir'
+
 RSpec.describe Numo::Libsvm do
   describe 'constant values' do
     it 'has version numbers', :aggregate_failures do
@@ -61,6 +63,13 @@ RSpec.describe Numo::Libsvm do
       expect(pr.shape[1]).to be_nil
       expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
     end
+
+    it 'predicts probabilities with C-SVC', :aggregate_failures do
+      pb = described_class.predict_proba(x_test, c_svc_param, c_svc_model)
+      pr = Numo::Int32[*Array.new(n_test_samples) { |n| classes[pb[n, true].max_index] }] # rubocop:disable Lint/RedundantSplatExpansion
+      expect(pb.shape).to eq([n_test_samples, n_classes])
+      expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
+    end
   end
 
   describe 'classification' do
@@ -88,6 +97,34 @@ RSpec.describe Numo::Libsvm do
       expect(accuracy(y, pr)).to be_within(0.05).of(0.95)
     end
 
+    it 'performs cross validation with multiple threads', :aggregate_failures do
+      param = c_svc_param.merge(random_seed: 1)
+      expected = described_class.cv(x, y, param, 5)
+      expect(described_class.cv(x, y, param.merge(n_jobs: 5), 5)).to eq(expected)
+      expect(described_class.cv(x, y, param.merge(n_jobs: 3), 5)).to eq(expected)
+    end
+
+    it 'trains C-SVC with warm start from the model of smaller C' do
+      param = c_svc_param.merge(kernel_type: Numo::Libsvm::KernelType::RBF, gamma: 0.5, probability: false, eps: 1e-6)
+      init_model = described_class.train(x, y, param.merge(C: 1))
+      warm_model = described_class.train(x, y, param, init_model: init_model)
+      cold_model = described_class.train(x, y, param)
+      df_warm = described_class.decision_function(x_test, param, warm_model)
+      df_cold = described_class.decision_function(x_test, param, cold_model)
+      expect((df_warm - df_cold).abs.max).to be <= 1e-3
+    end
+
+    it 'searches the best parameters in the grid on the same folds', :aggregate_failures do
+      param = c_svc_param.merge(probability: false, random_seed: 1)
+      grid = { C: [1, 10], gamma: [0.01, 0.1] }
+      res = described_class.grid_search(x, y, param, grid, 5)
+      expect(res[:params].map { |p| p.values_at(:C, :gamma) }).to eq([[1, 0.01], [1, 0.1], [10, 0.01], [10, 0.1]])
+      expect(res[:scores].shape).to eq([4])
+      expect(res[:best_param]).to eq(res[:params][res[:scores].max_index])
+      expect(res[:scores][0]).to eq(accuracy(y, described_class.cv(x, y, res[:params][0], 5)))
+      expect(described_class.grid_search(x, y, param.merge(n_jobs: 3), grid, 5)[:scores]).to eq(res[:scores])
+    end
+
     it 'calculates decision function with C-SVC', :aggregate_failures do
       df = described_class.decision_function(x_test, c_svc_param, c_svc_model)
       expect(df.class).to eq(Numo::DFloat)
@@ -126,6 +163,173 @@ RSpec.describe Numo::Libsvm do
         expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
       end
     end
+
+    context 'when given samples of SFloat, Int32, and UInt8' do
+      let(:x_int) { Numo::Int32.cast(dataset[0] * 10) }
+      let(:x_test_int) { Numo::Int32.cast(dataset[2] * 10) }
+      let(:c_svc_model) { described_class.train(Numo::DFloat.cast(x_int), y, c_svc_param) }
+
+      it 'gives the same results as the samples of DFloat', :aggregate_failures do
+        [Numo::SFloat, Numo::Int32, Numo::UInt8].each do |klass|
+          expect(described_class.train(klass.cast(x_int), y, c_svc_param)[:sv_coef]).to eq(c_svc_model[:sv_coef])
+          expect(described_class.decision_function(klass.cast(x_test_int), c_svc_param, c_svc_model))
+            .to eq(described_class.decision_function(Numo::DFloat.cast(x_test_int), c_svc_param, c_svc_model))
+          expect(described_class.predict(klass.cast(x_test_int), c_svc_param, c_svc_model))
+            .to eq(described_class.predict(Numo::DFloat.cast(x_test_int), c_svc_param, c_svc_model))
+        end
+      end
+    end
+
+    context 'when given sparse training data' do
+      let(:n_train_samples) { dataset[0].shape[0] }
+      let(:n_test_samples) { dataset[2].shape[0] }
+      let(:x) { Numo::NArray.hstack([Numo::DFloat.zeros(n_train_samples, 20), dataset[0]]) }
+      let(:x_test) { Numo::NArray.hstack([Numo::DFloat.zeros(n_test_samples, 20), dataset[2]]) }
+
+      it 'predicts labels and probabilities with C-SVC', :aggregate_failures do
+        pr = described_class.predict(x_test, c_svc_param, c_svc_model)
+        pb = described_class.predict_proba(x_test, c_svc_param, c_svc_model)
+        expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
+        expect((pb.sum(axis: 1) - 1).abs.max).to be < 1e-8
+      end
+
+      it 'gives the support vectors in CSR format', :aggregate_failures do
+        sparse_model = Numo::Libsvm::Model.new(c_svc_param, c_svc_model).to_h(sparse_sv: true)
+        indptr, indices, data = sparse_model[:SV]
+        expect(indptr.class).to eq(Numo::Int32)
+        expect(indptr.size).to eq(sparse_model[:l] + 1)
+        expect(indices.min).to be >= 20
+        expect(data.size).to eq(indptr[-1])
+        expect(described_class.predict_proba(x_test, c_svc_param, sparse_model))
+          .to eq(described_class.predict_proba(x_test, c_svc_param, c_svc_model))
+        expect(Numo::Libsvm::Model.new(c_svc_param, sparse_model).to_h[:SV]).to eq(c_svc_model[:SV])
+        param = c_svc_param.merge(random_seed: 1)
+        expect(described_class.train(x, y, param, sparse_sv: true)[:SV])
+          .to eq(Numo::Libsvm::Model.train(x, y, param).to_h(sparse_sv: true)[:SV])
+        Dir.mktmpdir do |dir|
+          filename = File.join(dir, 'model.txt')
+          described_class.save_svm_model(filename, c_svc_param, sparse_model)
+          _param, loaded = described_class.load_svm_model(filename, sparse_sv: true)
+          expect(loaded[:SV][1]).to eq(indices)
+          expect((loaded[:SV][2] - data).abs.max).to be < 1e-12
+        end
+      end
+    end
+
+    context 'when given samples in CSR format' do
+      let(:csr) do
+        lambda do |mat|
+          indptr = [0]
+          indices = []
+          data = []
+          mat.to_a.each do |row|
+            row.each_with_index do |v, j|
+              next if v.zero?
+
+              indices << j
+              data << v
+            end
+            indptr << indices.size
+          end
+          [Numo::Int32.cast(indptr), Numo::Int32.cast(indices), Numo::DFloat.cast(data)]
+        end
+      end
+
+      it 'gives the same results as the dense samples', :aggregate_failures do
+        expect(described_class.train_csr(*csr.call(x), y, c_svc_param)[:sv_coef]).to eq(c_svc_model[:sv_coef])
+        expect(described_class.train(Numo::Libsvm::Dataset.from_csr(*csr.call(x), y), c_svc_param)[:sv_coef])
+          .to eq(c_svc_model[:sv_coef])
+        x_csr = csr.call(x_test)
+        df = described_class.decision_function_csr(*x_csr, c_svc_param, c_svc_model)
+        pb = described_class.predict_proba_csr(*x_csr, c_svc_param, c_svc_model)
+        expect((df - described_class.decision_function(x_test, c_svc_param, c_svc_model)).abs.max).to be < 1e-8
+        expect((pb - described_class.predict_proba(x_test, c_svc_param, c_svc_model)).abs.max).to be < 1e-8
+        expect(described_class.predict_csr(*x_csr, c_svc_param, c_svc_model))
+          .to eq(described_class.predict(x_test, c_svc_param, c_svc_model))
+        expect(Numo::Libsvm::Model.train_csr(*csr.call(x), y, c_svc_param).predict_csr(*x_csr, n_jobs: 2))
+          .to eq(described_class.predict(x_test, c_svc_param, c_svc_model))
+      end
+
+      it 'raises ArgumentError when given unsorted column indices' do
+        x_csr = [Numo::Int32[0, 2], Numo::Int32[1, 0], Numo::DFloat[1, 2]]
+        expect { described_class.predict_csr(*x_csr, c_svc_param, c_svc_model) }.to raise_error(ArgumentError)
+      end
+    end
+
+    context 'when given views of samples' do
+      let(:param) { c_svc_param.merge(random_seed: 1) }
+      let(:x_view) { Numo::NArray.hstack([x, x]).transpose[0...x.shape[1], true].transpose }
+      let(:x_test_view) { x_test[x_test.shape[0] - 1..0, true][(x_test.shape[0] - 1..0).to_a, true] }
+
+      it 'gives the same results as the contiguous samples', :aggregate_failures do
+        expect(x_view).to eq(x)
+        expect(x_test_view).to eq(x_test)
+        expect(described_class.train(x_view, y, param)).to eq(described_class.train(x, y, param))
+        expect(described_class.decision_function(x_test_view, param, c_svc_model))
+          .to eq(described_class.decision_function(x_test, param, c_svc_model))
+        expect(described_class.predict(x_test_view, param, c_svc_model))
+          .to eq(described_class.predict(x_test, param, c_svc_model))
+        expect(Numo::Libsvm::Model.train(x_view, y, param).predict(x_test_view))
+          .to eq(described_class.predict(x_test, param, described_class.train(x, y, param)))
+      end
+    end
+
+    context 'when given dataset object' do
+      let(:dataset_obj) { Numo::Libsvm::Dataset.new(x, y) }
+      let(:param) { c_svc_param.merge(random_seed: 1) }
+
+      it 'gives the same results as the samples and labels', :aggregate_failures do
+        expect(dataset_obj.n_samples).to eq(x.shape[0])
+        expect(described_class.train(dataset_obj, param)).to eq(described_class.train(x, y, param))
+        expect(described_class.cv(dataset_obj, param, 5)).to eq(described_class.cv(x, y, param, 5))
+        expect(described_class.cv(dataset_obj.dup, param, 5)).to eq(described_class.cv(x, y, param, 5))
+        expect(described_class.train(Numo::Libsvm::Dataset.new(x, y, n_jobs: 3), param))
+          .to eq(described_class.train(x, y, param))
+        expect(described_class.grid_search(dataset_obj, param, { C: [1, 10] }, 5)[:scores])
+          .to eq(described_class.grid_search(x, y, param, { C: [1, 10] }, 5)[:scores])
+        expect(Numo::Libsvm::Model.train(dataset_obj, param).predict(x_test))
+          .to eq(described_class.predict(x_test, param, described_class.train(x, y, param)))
+      end
+
+      it 'shares the samples of dataset object with support vectors of the model', :aggregate_failures do
+        model = Numo::Libsvm::Model.train(Numo::Libsvm::Dataset.new(x, y), param, share_sv: true)
+        GC.start
+        expected = Numo::Libsvm::Model.train(x, y, param)
+        expect(model.to_h).to eq(expected.to_h)
+        expect(model.predict(x_test)).to eq(expected.predict(x_test))
+        expect(model.dup.decision_function(x_test)).to eq(expected.decision_function(x_test))
+        expect { dataset_obj.send(:initialize, x, y) }.to raise_error(RuntimeError)
+      end
+
+      it 'raises ArgumentError when given labels with dataset object' do
+        expect { described_class.train(dataset_obj, y, param) }.to raise_error(ArgumentError)
+      end
+    end
+
+    context 'when given linear kernel' do
+      let(:c_svc_param) do
+        { svm_type: Numo::Libsvm::SvmType::C_SVC,
+          kernel_type: Numo::Libsvm::KernelType::LINEAR,
+          C: 1,
+          probability: true,
+          random_seed: 1 }
+      end
+
+      it 'collapses support vectors to primal weight vectors', :aggregate_failures do
+        w = c_svc_model[:w]
+        expect(w.class).to eq(Numo::DFloat)
+        expect(w.shape).to eq([n_classes * (n_classes - 1) / 2, x.shape[1]])
+        df = described_class.decision_function(x_test, c_svc_param, c_svc_model)
+        expect((df - (x_test.dot(w.transpose) - c_svc_model[:rho].expand_dims(0))).abs.max).to be < 1e-8
+      end
+
+      it 'predicts labels and probabilities with C-SVC', :aggregate_failures do
+        pr = described_class.predict(x_test, c_svc_param, c_svc_model)
+        pb = described_class.predict_proba(x_test, c_svc_param, c_svc_model)
+        expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
+        expect((pb.sum(axis: 1) - 1).abs.max).to be < 1e-8
+      end
+    end
   end
 
   describe 'regression' do
@@ -163,6 +367,15 @@ RSpec.describe Numo::Libsvm do
       expect(err).to be <= 1e-8
     end
 
+    it 'trains SVR with warm start from the model of larger C' do
+      param = svr_param.merge(eps: 1e-6)
+      init_model = described_class.train(x, y, param.merge(C: 100))
+      warm_model = described_class.train(x, y, param, init_model: init_model)
+      pr_warm = described_class.predict(x_test, param, warm_model)
+      pr_cold = described_class.predict(x_test, param, described_class.train(x, y, param))
+      expect((pr_warm - pr_cold).abs.max).to be <= 1e-2
+    end
+
     it 'performs 5-cross validation with SVR' do
       pr = described_class.cv(x, y, svr_param, 5)
       expect(r2_score(y, pr)).to be >= 0.1
@@ -214,6 +427,151 @@ RSpec.describe Numo::Libsvm do
     end
   end
 
+  describe 'model object' do
+    let(:dataset) { Marshal.load(File.binread("#{__dir__}/../iris.dat")) }
+    let(:x) { dataset[0] }
+    let(:y) { dataset[1] }
+    let(:x_test) { dataset[2] }
+    let(:y_test) { dataset[3] }
+    let(:classes) { Numo::Int32[*y.to_a.uniq] }
+    let(:n_classes) { classes.size }
+    let(:n_test_samples) { x_test.shape[0] }
+    let(:param) do
+      { svm_type: Numo::Libsvm::SvmType::C_SVC,
+        kernel_type: Numo::Libsvm::KernelType::RBF,
+        gamma: 0.5,
+        C: 10,
+        probability: true,
+        random_seed: 1 }
+    end
+    let(:model_hash) { described_class.train(x, y, param) }
+    let(:model) { Numo::Libsvm::Model.train(x, y, param) }
+
+    it 'predicts labels', :aggregate_failures do
+      pr = model.predict(x_test)
+      expect(pr.class).to eq(Numo::DFloat)
+      expect(pr.shape[0]).to eq(n_test_samples)
+      expect(pr.shape[1]).to be_nil
+      expect(accuracy(y_test, pr)).to be_within(0.05).of(0.95)
+    end
+
+    it 'calculates decision function', :aggregate_failures do
+      df = model.decision_function(x_test)
+      expect(df.class).to eq(Numo::DFloat)
+      expect(df.shape[0]).to eq(n_test_samples)
+      expect(df.shape[1]).to eq(n_classes * (n_classes - 1) / 2)
+    end
+
+    it 'predicts probabilities', :aggregate_failures do
+      pb = model.predict_proba(x_test)
+      expect(pb.class).to eq(Numo::DFloat)
+      expect(pb.shape[0]).to eq(n_test_samples)
+      expect(pb.shape[1]).to eq(n_classes)
+    end
+
+    it 'gives the same results as the module functions with the model hash', :aggregate_failures do
+      model_obj = Numo::Libsvm::Model.new(param, model_hash)
+      expect(model_obj.predict(x_test)).to eq(described_class.predict(x_test, param, model_hash))
+      expect(model_obj.decision_function(x_test)).to eq(described_class.decision_function(x_test, param, model_hash))
+      expect(model_obj.to_h[:SV]).to eq(model_hash[:SV])
+      expect(model_obj.dup.predict(x_test)).to eq(model_obj.predict(x_test))
+      expect { model_obj.send(:initialize, param, model_hash) }.to raise_error(RuntimeError, /already initialized/)
+      expect { model_obj.send(:initialize_copy, model) }.to raise_error(RuntimeError, /already initialized/)
+    end
+
+    it 'predicts with multiple threads', :aggregate_failures do
+      expect(model.predict(x_test, n_jobs: 4)).to eq(model.predict(x_test))
+      expect(model.decision_function(x_test, n_jobs: -1)).to eq(model.decision_function(x_test))
+      expect(model.predict_proba(x_test, n_jobs: 2)).to eq(model.predict_proba(x_test))
+      expect(described_class.predict(x_test, param.merge(n_jobs: 4), model_hash))
+        .to eq(described_class.predict(x_test, param, model_hash))
+    end
+
+    it 'trains with warm start from the model object', :aggregate_failures do
+      init_model = Numo::Libsvm::Model.train(x, y, param.merge(C: 1))
+      warm_model = Numo::Libsvm::Model.train(x, y, param, init_model: init_model)
+      expect(warm_model.class).to eq(Numo::Libsvm::Model)
+      expect(accuracy(y_test, warm_model.predict(x_test))).to be_within(0.05).of(0.95)
+    end
+
+    it 'trains the pairs of classes with multiple threads', :aggregate_failures do
+      [2, 4, -1].each do |n_jobs|
+        trained = described_class.train(x, y, param.merge(n_jobs: n_jobs))
+        %i[sv_coef rho probA probB sv_indices nSV].each { |key| expect(trained[key]).to eq(model_hash[key]) }
+      end
+    end
+
+    it 'calibrates the probabilities of two classes with multiple threads', :aggregate_failures do
+      ids = y.ne(classes[2]).where
+      expected = described_class.train(x[ids, true], y[ids], param)
+      trained = described_class.train(x[ids, true], y[ids], param.merge(n_jobs: 6))
+      %i[sv_coef rho probA probB].each { |key| expect(trained[key]).to eq(expected[key]) }
+    end
+
+    it 'trains and predicts in multiple threads concurrently', :aggregate_failures do
+      expected = model.predict(x_test)
+      threads = Array.new(4) { Thread.new { Numo::Libsvm::Model.train(x, y, param).predict(x_test) } }
+      threads.each { |th| expect(th.value).to eq(expected) }
+    end
+
+    it 'saves and loads the model with LIBSVM format', :aggregate_failures do
+      Dir.mktmpdir do |dir|
+        filename = File.join(dir, 'model.txt')
+        expect(model.save_svm_model(filename)).to be_truthy
+        loaded = Numo::Libsvm::Model.load_svm_model(filename)
+        expect(loaded.param[:kernel_type]).to eq(Numo::Libsvm::KernelType::RBF)
+        expect(loaded.predict(x_test)).to eq(model.predict(x_test))
+        parallel_loaded = Numo::Libsvm::Model.load_svm_model(filename, n_jobs: 2)
+        expect(parallel_loaded.to_h).to eq(loaded.to_h)
+        parallel_filename = File.join(dir, 'parallel_model.txt')
+        expect(model.save_svm_model(parallel_filename, n_jobs: 2)).to be_truthy
+        expect(File.read(parallel_filename)).to eq(File.read(filename))
+        lines = File.read(filename).lines
+        File.write(filename, [*lines[0...-1], lines[-1].sub(/\A\S+ \S+/, '1e400 -1e-400')].join)
+        out_of_range = Numo::Libsvm::Model.load_svm_model(filename).to_h[:sv_coef]
+        expect(out_of_range[true, -1].to_a).to eq([Float::INFINITY, 0.0])
+        File.write(filename, lines[0...-1].join)
+        expect { Numo::Libsvm::Model.load_svm_model(filename) }.to raise_error(IOError)
+      end
+    end
+
+    it 'saves and loads the model with binary format', :aggregate_failures do
+      Dir.mktmpdir do |dir|
+        filename = File.join(dir, 'model.bin')
+        expect(model.save_binary_model(filename)).to be_truthy
+        loaded = Numo::Libsvm::Model.load_binary_model(filename)
+        expect(loaded.param).to eq(model.param)
+        %i[SV sv_coef rho probA probB sv_indices label nSV].each { |key| expect(loaded.to_h[key]).to eq(model.to_h[key]) }
+        expect(loaded.dup.predict_proba(x_test)).to eq(model.predict_proba(x_test))
+        blob = File.binread(filename)
+        # The byte offset of the nodes of support vectors is at byte 184 of the header.
+        blob[blob[184, 8].unpack1('Q'), 4] = [0].pack('l')
+        File.binwrite(filename, blob)
+        expect { Numo::Libsvm::Model.load_binary_model(filename) }.to raise_error(IOError, /not positive and increasing/)
+        File.binwrite(filename, File.binread(filename)[0...-16])
+        expect { Numo::Libsvm::Model.load_binary_model(filename) }.to raise_error(IOError, /sections are truncated/)
+      end
+    end
+
+    it 'is dumped and loaded with Marshal', :aggregate_failures do
+      loaded = Marshal.load(Marshal.dump(model))
+      expect(loaded).to be_a(Numo::Libsvm::Model)
+      expect(loaded.param).to eq(model.param)
+      expect(loaded.to_h).to eq(model.to_h)
+      expect(loaded.predict_proba(x_test)).to eq(model.predict_proba(x_test))
+      expect { Numo::Libsvm::Model._load('foo') }.to raise_error(ArgumentError, /not a binary model file/)
+      blob = model._dump(-1)
+      blob[blob[184, 8].unpack1('Q'), 4] = [2**31 - 2].pack('l')
+      expect { Numo::Libsvm::Model._load(blob) }.to raise_error(ArgumentError, /not positive and increasing/)
+    end
+
+    it 'raises ArgumentError when given non two-dimensional array as sample array' do
+      expect do
+        model.predict(Numo::DFloat.new(3, 2, 2).rand)
+      end.to raise_error(ArgumentError, 'Expect samples to be 2-D array.')
+    end
+  end
+
   describe 'errors' do
     let(:dataset) { Marshal.load(File.binread("#{__dir__}/../iris.dat")) }
     let(:x) { dataset[0] }
@@ -260,6 +618,56 @@ RSpec.describe Numo::Libsvm do
       end
     end
 
+    describe '#grid_search' do
+      it 'raises ArgumentError when given grid that is not a hash of non-empty arrays', :aggregate_failures do
+        expect do
+          described_class.grid_search(x, y, svm_param, [[:C, [1, 10]]], 5)
+        end.to raise_error(ArgumentError, 'Expect grid to be a Hash.')
+        expect do
+          described_class.grid_search(x, y, svm_param, { C: [] }, 5)
+        end.to raise_error(ArgumentError, 'Expect each value of grid to be a non-empty Array.')
+      end
+
+      it 'raises ArgumentError when given grid that varies svm type' do
+        expect do
+          described_class.grid_search(x, y, svm_param, { svm_type: [Numo::Libsvm::SvmType::C_SVC] }, 5)
+        end.to raise_error(ArgumentError, 'Expect grid not to have svm_type, which is shared by the candidates.')
+      end
+
+      it 'raises ArgumentError when given no samples' do
+        expect do
+          described_class.grid_search(Numo::DFloat.zeros(0, 2), Numo::DFloat.zeros(0), svm_param, { C: [1] }, 5)
+        end.to raise_error(ArgumentError, 'Expect to have at least one sample.')
+      end
+
+      it 'raises ArgumentError when given invalid parameter value for libsvm' do
+        expect do
+          described_class.grid_search(x, y, svm_param, { gamma: [0.1, -100] }, 5)
+        end.to raise_error(ArgumentError, 'Invalid LIBSVM parameter is given: gamma < 0')
+      end
+
+      it 'raises TypeError when given parameter value that is not a number' do
+        expect do
+          described_class.grid_search(x, y, svm_param, { C: [1, 'a'] }, 5)
+        end.to raise_error(TypeError)
+      end
+    end
+
+    describe '#train with init_model' do
+      it 'raises ArgumentError when given svm type that does not support warm start' do
+        nu_param = svm_param.merge(svm_type: Numo::Libsvm::SvmType::NU_SVC, nu: 0.5)
+        expect do
+          described_class.train(x, y, nu_param, init_model: svm_model)
+        end.to raise_error(ArgumentError, /warm start is only available for C-SVC and epsilon-SVR/)
+      end
+
+      it 'raises ArgumentError when given initial model trained on other samples' do
+        expect do
+          described_class.train(x[0...10, true], y[0...10], svm_param, init_model: svm_model)
+        end.to raise_error(ArgumentError, 'Invalid initial model is given: sv_indices are out of range of samples')
+      end
+    end
+
     describe '#cv' do
       it 'raises ArgumentError when given non two-dimensional array as sample array' do
         expect do
@@ -315,6 +723,25 @@ RSpec.describe Numo::Libsvm do
       end
     end
 
+    describe '#predict with support vectors in CSR format' do
+      it 'raises ArgumentError when given invalid CSR matrix of support vectors' do
+        sparse_model = svm_model.merge(SV: [Numo::Int32[0, 1], Numo::Int32[0], Numo::DFloat[1]])
+        expect do
+          described_class.predict(Numo::DFloat.new(3, 2).rand, svm_param, sparse_model)
+        end.to raise_error(ArgumentError, /Expect support vectors of CSR matrix/)
+      end
+
+      it 'raises ArgumentError when given CSR matrix of support vectors with non-monotonic row pointers' do
+        indptr = Numo::Int32.zeros(svm_model[:l] + 1)
+        indptr[1] = 100
+        indptr[-1] = 5
+        sparse_model = svm_model.merge(SV: [indptr, Numo::Int32[0, 1, 2, 3, 4], Numo::DFloat.ones(5)])
+        expect do
+          described_class.predict(Numo::DFloat.new(3, 2).rand, svm_param, sparse_model)
+        end.to raise_error(ArgumentError, /Expect support vectors of CSR matrix to have valid row pointers/)
+      end
+    end
+
     describe '#load_svm_model' do
       it 'raises IOError when failed load file' do
         expect { described_class.load_svm_model('foo') }.to raise_error(IOError, "Failed to load file 'foo'")